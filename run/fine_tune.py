@@ -0,0 +1,49 @@
+import argparse, os, random
+import numpy as np
+import lbf
+import validation
+from validation import build_corpus, report
+
+def main():
+	assert args.dataset_directory is not None
+	validation.args = args
+	model = lbf.model(args.model_filename)
+	mean_shape = model.get_mean_shape()
+	training_corpus, _ = build_corpus(args.training_targets, mean_shape=mean_shape)
+	validation_corpus, _ = build_corpus(args.validation_targets, mean_shape=mean_shape)
+	print("#images (train):", len(training_corpus))
+	print("#images (val):", len(validation_corpus))
+	report(model, validation_corpus, "before")
+
+	# the forests stay fixed and only the regression weights follow the new faces
+	fine_tuner = lbf.fine_tuner(model, learning_rate=args.learning_rate, regularization=args.regularization)
+	for epoch in range(args.num_epochs):
+		random.shuffle(training_corpus)
+		errors = []
+		for start in range(0, len(training_corpus), args.batch_size):
+			batch = lbf.corpus()
+			for (image, shape, normalized_shape, rotation, rotation_inv, shift, shift_inv, pupil_distance) in training_corpus[start:start + args.batch_size]:
+				batch.add(image, shape, normalized_shape, rotation, rotation_inv, shift, shift_inv, pupil_distance)
+			errors.append(fine_tuner.update(batch))
+		print("epoch {}: mean error {:.4f} %".format(epoch, np.mean(errors)))
+
+	report(model, validation_corpus, "after")
+	model.save(args.output_filename)
+	model.save_inference_model(os.path.splitext(args.output_filename)[0] + ".lbfi")
+
+if __name__ == "__main__":
+	parser = argparse.ArgumentParser()
+	parser.add_argument("--dataset-directory", "-dataset", type=str, default=None)
+	parser.add_argument("--debug-directory", "-debug", type=str, default=None)
+	parser.add_argument("--model-filename", "-model", type=str, default="lbf.model")
+	parser.add_argument("--output-filename", "-output", type=str, default="tuned.model")
+	parser.add_argument("--training-targets", type=str, nargs="+", default=["afw", "ibug"])	# directories of the new domain
+	parser.add_argument("--validation-targets", type=str, nargs="+", default=["helen/testset", "lfpw/testset"])
+	parser.add_argument("--max-image-size", "-size", type=int, default=500)
+	parser.add_argument("--failure-threshold", "-threshold", type=float, default=0.08)
+	parser.add_argument("--learning-rate", "-lr", type=float, default=0.5)
+	parser.add_argument("--regularization", "-reg", type=float, default=0)
+	parser.add_argument("--batch-size", "-batch", type=int, default=32)
+	parser.add_argument("--num-epochs", "-epochs", type=int, default=5)
+	args = parser.parse_args()
+	main()
\ No newline at end of file
@@ -0,0 +1,52 @@
+import argparse, os
+import lbf
+import validation
+from validation import build_corpus
+
+def to_lbf_corpus(corpus):
+	lbf_corpus = lbf.corpus()
+	for (image, shape, normalized_shape, rotation, rotation_inv, shift, shift_inv, pupil_distance) in corpus:
+		lbf_corpus.add(image, shape, normalized_shape, rotation, rotation_inv, shift, shift_inv, pupil_distance)
+	return lbf_corpus
+
+def print_report(tolerance, report):
+	num_removed_forests = len([tree_index for (stage, landmark_index, tree_index, error) in report["removed"] if tree_index < 0])
+	print("{}	{}	{}	{:.4f}	{:.4f}	{:.1f}	{:.1f}".format(tolerance, num_removed_forests, report["num_removed_trees"], 
+		report["error_before"], report["error_after"], report["time_before"], report["time_after"]))
+
+def main():
+	assert args.dataset_directory is not None
+	validation.args = args
+	validation_targets = ["helen/testset", "lfpw/testset"]
+	mean_shape = lbf.model(args.model_filename).get_mean_shape()
+	validation_corpus, _ = build_corpus(validation_targets, mean_shape=mean_shape)
+	lbf_validation_corpus = to_lbf_corpus(validation_corpus)
+	print("#images (val):", len(validation_corpus))
+
+	# removals and speed at each tolerance
+	print("tolerance	#removed forests	#removed trees	error before (%)	error after (%)	time before (us)	time after (us)")
+	for tolerance in args.tolerances:
+		model = lbf.model(args.model_filename)
+		print_report(tolerance, model.prune(lbf_validation_corpus, tolerance))
+
+	if args.tolerance > 0:
+		model = lbf.model(args.model_filename)
+		report = model.prune(lbf_validation_corpus, args.tolerance)
+		for (stage, landmark_index, tree_index, error) in report["removed"]:
+			if tree_index < 0:
+				print("stage {} landmark {}: forest removed, error {:.4f}".format(stage, landmark_index, error))
+			else:
+				print("stage {} landmark {}: tree {} removed, error {:.4f}".format(stage, landmark_index, tree_index, error))
+		model.save(args.output_filename)
+		model.save_inference_model(os.path.splitext(args.output_filename)[0] + ".lbfi")
+
+if __name__ == "__main__":
+	parser = argparse.ArgumentParser()
+	parser.add_argument("--dataset-directory", "-dataset", type=str, default=None)
+	parser.add_argument("--model-filename", "-model", type=str, default="lbf.model")
+	parser.add_argument("--output-filename", "-output", type=str, default="pruned.model")
+	parser.add_argument("--max-image-size", "-size", type=int, default=500)
+	parser.add_argument("--tolerances", type=float, nargs="*", default=[0.05, 0.1, 0.2, 0.5])	# allowed rise of the validation error in % of the pupil distance
+	parser.add_argument("--tolerance", "-tolerance", type=float, default=0)	# the model pruned at this tolerance is saved
+	args = parser.parse_args()
+	main()
\ No newline at end of file
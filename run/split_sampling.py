@@ -0,0 +1,70 @@
+import argparse, time
+import numpy as np
+import lbf
+import validation
+from validation import build_corpus
+
+def to_lbf_corpus(corpus):
+	lbf_corpus = lbf.corpus()
+	for (image, shape, normalized_shape, rotation, rotation_inv, shift, shift_inv, pupil_distance) in corpus:
+		lbf_corpus.add(image, shape, normalized_shape, rotation, rotation_inv, shift, shift_inv, pupil_distance)
+	return lbf_corpus
+
+def measure(model, corpus):
+	errors = []
+	for (image, shape, normalized_shape, rotation, rotation_inv, shift, shift_inv, pupil_distance) in corpus:
+		errors.append(model.compute_error(image, normalized_shape, rotation_inv, shift_inv, pupil_distance)[-1])
+	return np.mean(errors)
+
+def main():
+	assert args.dataset_directory is not None
+	validation.args = args
+	training_targets = ["afw", "ibug", "helen/trainset", "lfpw/trainset"]
+	validation_targets = ["helen/testset", "lfpw/testset"]
+	training_corpus, mean_shape = build_corpus(training_targets)
+	validation_corpus, _ = build_corpus(validation_targets, mean_shape=mean_shape)
+	print("#images (train):", len(training_corpus))
+	print("#images (val):", len(validation_corpus))
+	lbf_training_corpus = to_lbf_corpus(training_corpus)
+	lbf_validation_corpus = to_lbf_corpus(validation_corpus)
+
+	# training time and accuracy of the first stages for each setting of the split search
+	feature_radius = [0.29, 0.21, 0.16, 0.12, 0.08][:args.num_stages]
+	results = []
+	for num_features_per_node in args.features_per_node:
+		for max_split_samples in args.max_split_samples:
+			model = lbf.model(num_stages=args.num_stages,
+							  num_trees_per_forest=args.num_trees_per_forest,
+							  tree_depth=args.tree_depth,
+							  num_landmarks=len(mean_shape),
+							  mean_shape_ndarray=mean_shape, 
+							  feature_radius=feature_radius)
+			model.set_split_sampling(num_features_per_node, max_split_samples)
+			trainer = lbf.trainer(training_corpus=lbf_training_corpus,
+								  validation_corpus=lbf_validation_corpus,
+								  model=model,
+								  augmentation_size=args.augmentation_size,
+								  num_features_to_sample=args.num_training_features)
+			start = time.perf_counter()
+			for stage in range(args.num_stages):
+				trainer.train_stage(stage)
+			elapsed = time.perf_counter() - start
+			results.append((num_features_per_node, max_split_samples, elapsed, measure(model, validation_corpus)))
+
+	print("features per node	max split samples	training time (s)	error (%)")
+	for result in results:
+		print("{}	{}	{:.1f}	{:.4f}".format(*result))
+
+if __name__ == "__main__":
+	parser = argparse.ArgumentParser()
+	parser.add_argument("--dataset-directory", "-dataset", type=str, default=None)
+	parser.add_argument("--max-image-size", "-size", type=int, default=300)
+	parser.add_argument("--augmentation-size", "-augment", type=int, default=20)
+	parser.add_argument("--num-stages", "-stages", type=int, default=2)
+	parser.add_argument("--num-trees-per-forest", "-trees", type=int, default=17)
+	parser.add_argument("--num-training-features", "-features", type=int, default=500)
+	parser.add_argument("--tree-depth", "-depth", type=int, default=7)
+	parser.add_argument("--features-per-node", type=int, nargs="*", default=[0, 200, 100, 50])	# 0 tries all features
+	parser.add_argument("--max-split-samples", type=int, nargs="*", default=[0, 4000, 1000])		# 0 uses all data of a node
+	args = parser.parse_args()
+	main()
\ No newline at end of file
@@ -274,6 +274,14 @@ def main():
 
 	# resume training
 	model.load(args.model_filename)
+	model.set_complete_trees(args.complete_trees)
+	model.set_split_sampling(args.features_per_node, args.max_split_samples)
+	if args.pyramid_levels > 1:
+		model.set_image_pyramid(args.pyramid_levels)
+	for stage, box_radius in enumerate(args.box_radius):
+		model.set_box_features(stage, box_radius)
+	for stage in args.bilinear_stages:
+		model.set_bilinear_features(stage, True)
 
 	# training
 	trainer = lbf.trainer(training_corpus=training_corpus,
@@ -282,6 +290,29 @@ def main():
 						  augmentation_size=args.augmentation_size,
 						  num_features_to_sample=args.num_training_features)
 
+	# checkpoint every trained forest and regressor, resume from the journal if it exists
+	if args.journal_filename is not None:
+		trainer.set_journal(args.journal_filename)
+
+	# start the regressors from the ones of a previous run
+	if args.warm_start_model_filename is not None:
+		warm_start_model = lbf.model(args.warm_start_model_filename)
+		trainer.set_warm_start_model(warm_start_model)
+
+	# share the forests and the regressors with the processes of the same directory
+	if args.cluster_directory is not None:
+		try:
+			os.mkdir(args.cluster_directory)
+		except:
+			pass
+		trainer.set_cluster_timeout(args.cluster_timeout)
+		if args.worker:
+			trainer.join_cluster(args.cluster_directory)
+			for stage in range(args.num_stages):
+				trainer.train_stage(stage)
+			return
+		trainer.set_cluster(args.cluster_directory)
+
 	for stage in range(args.num_stages):
 		trainer.train_stage(stage)
 		trainer.evaluate_stage(stage)
@@ -292,11 +323,22 @@ if __name__ == "__main__":
 	parser.add_argument("--dataset-directory", "-dataset", type=str, default=None)
 	parser.add_argument("--debug-directory", "-debug", type=str, default=None)
 	parser.add_argument("--model-filename", "-model", type=str, default="lbf.model")
+	parser.add_argument("--journal-filename", "-journal", type=str, default=None)
+	parser.add_argument("--warm-start-model-filename", "-warm", type=str, default=None)
+	parser.add_argument("--cluster-directory", "-cluster", type=str, default=None)
+	parser.add_argument("--worker", action="store_true", default=False)
+	parser.add_argument("--cluster-timeout", type=float, default=3600)	# seconds to wait for a result of another process
 	parser.add_argument("--max-image-size", "-size", type=int, default=300)
 	parser.add_argument("--augmentation-size", "-augment", type=int, default=20)
 	parser.add_argument("--num-stages", "-stages", type=int, default=5)
 	parser.add_argument("--num-trees-per-forest", "-trees", type=int, default=17)
 	parser.add_argument("--num-training-features", "-features", type=int, default=500)
 	parser.add_argument("--tree-depth", "-depth", type=int, default=7)
+	parser.add_argument("--complete-trees", "-complete", action="store_true", default=False)
+	parser.add_argument("--features-per-node", "-mtry", type=int, default=0)	# 0 tries all features at every split
+	parser.add_argument("--max-split-samples", type=int, default=0)			# 0 uses all data of a node
+	parser.add_argument("--pyramid-levels", "-pyramid", type=int, default=1)
+	parser.add_argument("--box-radius", "-box", type=float, nargs="*", default=[])	# per stage, 0 uses single pixels
+	parser.add_argument("--bilinear-stages", "-bilinear", type=int, nargs="*", default=[])	# stages that interpolate their pixel features
 	args = parser.parse_args()
 	main()
\ No newline at end of file
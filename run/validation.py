@@ -233,6 +233,22 @@ def imwrite(image_gray, shape, filename):
 		cv2.line(image_bgr, (x, y - 4), (x, y + 4), color, 1)
 	cv2.imwrite(os.path.join(args.debug_directory, filename), image_bgr)
 
+# metrics of all images computed in one pass by the native evaluator
+def report(model, corpus, name):
+	lbf_corpus = lbf.corpus()
+	for (image, shape, normalized_shape, rotation, rotation_inv, shift, shift_inv, pupil_distance) in corpus:
+		lbf_corpus.add(image, shape, normalized_shape, rotation, rotation_inv, shift, shift_inv, pupil_distance)
+	evaluator = lbf.evaluator(model, lbf_corpus, threshold=args.failure_threshold)
+	evaluator.evaluate()
+	for normalization in ["inter_ocular", "pupil"]:
+		print(normalization)
+		print("	NME at each stage:", evaluator.get_stage_errors(normalization))
+		print("	AUC@{}: {}".format(args.failure_threshold, evaluator.get_auc(normalization)))
+		print("	failure rate:", evaluator.get_failure_rate(normalization))
+	if args.debug_directory is not None:
+		np.save(os.path.join(args.debug_directory, "{}_ced.npy".format(name)), evaluator.get_ced("inter_ocular"))
+		np.save(os.path.join(args.debug_directory, "{}_landmark_errors.npy".format(name)), evaluator.get_landmark_errors("inter_ocular"))
+
 def main():
 	assert args.dataset_directory is not None
 
@@ -264,9 +280,8 @@ def main():
 
 	# training data
 	print("#", len(training_corpus))
+	report(model, training_corpus, "train")
 	for data_index, (image, shape, normalized_shape, rotation, rotation_inv, shift, shift_inv, pupil_distance) in enumerate(training_corpus):
-		error = model.compute_error(image, normalized_shape, rotation_inv, shift_inv, pupil_distance)
-		print(error)
 		if args.debug_directory is not None:
 			shape = model.estimate_shape_by_translation(image, rotation_inv, shift_inv)
 			shape = np.transpose(np.dot(rotation_inv, shape.T) + shift_inv[:, None], (1, 0))
@@ -274,9 +289,8 @@ def main():
 
 	# validation data
 	print("#", len(validation_corpus))
+	report(model, validation_corpus, "validation")
 	for data_index, (image, shape, normalized_shape, rotation, rotation_inv, shift, shift_inv, pupil_distance) in enumerate(validation_corpus):
-		error = model.compute_error(image, normalized_shape, rotation_inv, shift_inv, pupil_distance)
-		print(error)
 		if args.debug_directory is not None:
 			shape = model.estimate_shape_by_translation(image, rotation_inv, shift_inv)
 			shape = np.transpose(np.dot(rotation_inv, shape.T) + shift_inv[:, None], (1, 0))
@@ -288,6 +302,7 @@ if __name__ == "__main__":
 	parser.add_argument("--debug-directory", "-debug", type=str, default=None)
 	parser.add_argument("--model-filename", "-model", type=str, default="lbf.model")
 	parser.add_argument("--max-image-size", "-size", type=int, default=500)
+	parser.add_argument("--failure-threshold", "-threshold", type=float, default=0.08)
 	parser.add_argument("--augmentation-size", "-augment", type=int, default=20)
 	parser.add_argument("--num-stages", "-stages", type=int, default=5)
 	parser.add_argument("--num-trees-per-forest", "-trees", type=int, default=17)
@@ -1,13 +1,14 @@
 from imutils.video import VideoStream
 import argparse, imutils, time, dlib, cv2
+import numpy as np
 import lbf
 
-def clip(image, rect, padding):
+def padded_box(image, rect, padding):
 	top = int(max(0, rect.top() - padding))
 	left = int(max(0, rect.left() - padding))
 	bottom = int(min(image.shape[0], rect.bottom() + padding))
 	right = int(min(image.shape[1], rect.right() + padding))
-	return image[top:bottom, left:right]
+	return [left, top, right, bottom]
 
 def main():
 	detector = dlib.get_frontal_face_detector()
@@ -23,22 +24,16 @@ def main():
 
 		rects = detector(gray, 0)
 
-		for rect in rects:
-			padding = rect.width() * 0.3
-			face = clip(gray, rect, padding)
-			face_rgb = clip(frame, rect, padding)
-			face_height, face_width = face.shape
-			face_width /= 2
-			face_height /= 2
-			shape = model.estimate_shape(face)
-			white = (255, 255, 255)
+		boxes = np.array([padded_box(gray, rect, rect.width() * 0.3) for rect in rects], dtype=np.float64).reshape((-1, 4))
+		shapes = model.estimate_shapes_in_frame(gray, boxes)	# frame coordinates
+		white = (255, 255, 255)
+		for shape in shapes:
 			for (x, y) in shape:
-				x = int(face_width + x * face_width)
-				y = int(face_height + y * face_height)
-				cv2.line(face_rgb, (x - 4, y), (x + 4, y), white, 1)
-				cv2.line(face_rgb, (x, y - 4), (x, y + 4), white, 1)
-			cv2.imshow("face", face_rgb)
-		  
+				x = int(x)
+				y = int(y)
+				cv2.line(frame, (x - 4, y), (x + 4, y), white, 1)
+				cv2.line(frame, (x, y - 4), (x, y + 4), white, 1)
+
 		cv2.imshow("frame", frame)
 		key = cv2.waitKey(1) & 0xFF
 		if key == ord("q"):
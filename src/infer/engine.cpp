@@ -0,0 +1,702 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <streambuf>
+#include "engine.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LBF_INFER_MMAP
+#endif
+
+namespace lbf {
+	namespace infer {
+		static const char MAGIC[4] = {'L', 'B', 'F', 'I'};
+		static const int FORMAT_VERSION = 2;		// 2 : nodes may be of BILINEAR_FEATURE
+
+		template <typename T>
+		static void write_value(std::ofstream &ofs, const T &value){
+			ofs.write(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+		template <typename T>
+		static void write_vector(std::ofstream &ofs, const std::vector<T> &values){
+			int size = values.size();
+			write_value(ofs, size);
+			ofs.write(reinterpret_cast<const char*>(values.data()), sizeof(T) * size);
+		}
+		template <typename T>
+		static bool read_value(std::istream &ifs, T &value){
+			ifs.read(reinterpret_cast<char*>(&value), sizeof(T));
+			return ifs.good();
+		}
+		// bytes from the read position to the end of the stream, 0 if the stream can not seek
+		static size_t get_remaining_size(std::istream &ifs){
+			std::streampos position = ifs.tellg();
+			if(position < 0){
+				return 0;
+			}
+			ifs.seekg(0, std::ios::end);
+			std::streampos end = ifs.tellg();
+			ifs.seekg(position);
+			if(ifs.good() == false || end < position){
+				return 0;
+			}
+			return end - position;
+		}
+		// a size beyond max_size or beyond the rest of the stream is rejected before anything is allocated
+		template <typename T>
+		static bool read_vector(std::istream &ifs, std::vector<T> &values, size_t max_size = SIZE_MAX){
+			int size = 0;
+			if(read_value(ifs, size) == false || size < 0 || (size_t)size > max_size || (size_t)size > get_remaining_size(ifs) / sizeof(T)){
+				return false;
+			}
+			values.resize(size);
+			ifs.read(reinterpret_cast<char*>(values.data()), sizeof(T) * size);
+			return ifs.good();
+		}
+
+		// reads the mapped file in place
+		class MemoryBuffer : public std::streambuf {
+		public:
+			MemoryBuffer(const char* data, size_t size){
+				char* begin = const_cast<char*>(data);
+				setg(begin, begin, begin + size);
+			}
+		protected:
+			pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode){
+				char* position = (direction == std::ios_base::beg) ? eback() : (direction == std::ios_base::cur) ? gptr() : egptr();
+				position += offset;
+				if(position < eback() || position > egptr()){
+					return pos_type(off_type(-1));
+				}
+				setg(eback(), position, egptr());
+				return pos_type(position - eback());
+			}
+			pos_type seekpos(pos_type position, std::ios_base::openmode mode){
+				return seekoff(off_type(position), std::ios_base::beg, mode);
+			}
+		};
+
+		Stage::Stage(){
+			trained = false;
+			pyramid_level = 0;
+			num_leaves = 0;
+			mapped_weights = NULL;
+			num_mapped_weights = 0;
+		}
+		const float* Stage::get_weights() const {
+			return mapped_weights ? mapped_weights : weights.data();
+		}
+		size_t Stage::get_num_weights() const {
+			return mapped_weights ? num_mapped_weights : weights.size();
+		}
+		MappedFile::MappedFile(){
+			_data = NULL;
+			_size = 0;
+		}
+		MappedFile::~MappedFile(){
+#ifdef LBF_INFER_MMAP
+			if(_data != NULL){
+				munmap(const_cast<char*>(_data), _size);
+			}
+#endif
+		}
+		bool MappedFile::open(const std::string &filename){
+#ifdef LBF_INFER_MMAP
+			int descriptor = ::open(filename.c_str(), O_RDONLY);
+			if(descriptor < 0){
+				return false;
+			}
+			struct stat status;
+			if(fstat(descriptor, &status) != 0 || status.st_size <= 0){
+				close(descriptor);
+				return false;
+			}
+			void* data = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+			close(descriptor);
+			if(data == MAP_FAILED){
+				return false;
+			}
+			_data = static_cast<const char*>(data);
+			_size = status.st_size;
+			return true;
+#else
+			return false;
+#endif
+		}
+		EarlyExit::EarlyExit(){
+			tolerance = 0;
+			budget = 0;
+		}
+		Transform::Transform(){
+			rotation[0] = 1;
+			rotation[1] = 0;
+			rotation[2] = 0;
+			rotation[3] = 1;
+			shift[0] = 0;
+			shift[1] = 0;
+		}
+		// level 0 is the caller's buffer and is not copied. the buffers are reused across calls with the same image size.
+		void Workspace::set_image(const uint8_t* pixels, int width, int height, int stride, int num_levels, bool integral){
+			assert(num_levels > 0);
+			_level_buffers.resize(num_levels);
+			_levels.resize(num_levels);
+			ImageView &base = _levels[0];
+			base.pixels = pixels;
+			base.width = width;
+			base.height = height;
+			base.stride = stride;
+			for(int level = 1;level < num_levels;level++){
+				const ImageView &previous = _levels[level - 1];
+				ImageView &view = _levels[level];
+				view.width = (previous.width + 1) / 2;
+				view.height = (previous.height + 1) / 2;
+				view.stride = view.width;
+				std::vector<uint8_t> &buffer = _level_buffers[level];
+				buffer.resize(view.width * view.height);
+				pyramid_down(previous, buffer.data(), view.stride);
+				view.pixels = buffer.data();
+			}
+			_integral_buffers.resize(integral ? num_levels : 0);
+			_integrals.resize(num_levels);
+			for(int level = 0;level < num_levels;level++){
+				const ImageView &image = _levels[level];
+				IntegralView &view = _integrals[level];
+				view.sums = NULL;
+				view.width = image.width;
+				view.height = image.height;
+				view.stride = image.width + 1;
+				if(integral == false){
+					continue;
+				}
+				std::vector<int> &buffer = _integral_buffers[level];
+				buffer.resize((image.width + 1) * (image.height + 1));
+				infer::integral(image, buffer.data(), view.stride);
+				view.sums = buffer.data();
+			}
+		}
+		Engine::Engine(){
+			_num_stages = 0;
+			_num_landmarks = 0;
+		}
+		void Engine::init(int num_stages, int num_landmarks, const double* mean_shape){
+			_num_stages = num_stages;
+			_num_landmarks = num_landmarks;
+			_mean_shape.assign(mean_shape, mean_shape + num_landmarks * 2);
+			_stages.clear();
+			_stages.resize(num_stages);
+		}
+		// called once the trees and the regression table of a stage are filled in
+		void Engine::finish_stage(int stage_index){
+			assert(stage_index < _stages.size());
+			_finish_stage(_stages[stage_index]);
+		}
+		void Engine::_finish_stage(Stage &stage) const {
+			assert(stage.tree_offsets.size() == _num_landmarks + 1);
+			assert(stage.get_num_weights() == stage.num_leaves * _num_landmarks * 2);
+			stage.forest_depths.assign(_num_landmarks, 0);
+			for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
+				int first_tree = stage.tree_offsets[landmark_index];
+				int last_tree = stage.tree_offsets[landmark_index + 1];
+				if(first_tree == last_tree){
+					continue;
+				}
+				int depth = stage.trees[first_tree].depth;
+				for(int tree_index = first_tree;tree_index < last_tree;tree_index++){
+					if(stage.trees[tree_index].depth != depth){
+						depth = 0;
+					}
+				}
+				stage.forest_depths[landmark_index] = depth;
+			}
+			_build_features(stage);
+			stage.trained = true;
+		}
+		// the features of a landmark are merged where all of their parameters are equal
+		void Engine::_build_features(Stage &stage) const {
+			stage.features.clear();
+			stage.feature_offsets.assign(1, 0);
+			stage.feature_nodes.resize(stage.nodes.size());
+			for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
+				std::map<std::vector<double>, int> feature_indices;
+				int first_feature = stage.features.size();
+				for(int tree_index = stage.tree_offsets[landmark_index];tree_index < stage.tree_offsets[landmark_index + 1];tree_index++){
+					int first_node = stage.trees[tree_index].first_node;
+					int last_node = (tree_index + 1 < stage.trees.size()) ? stage.trees[tree_index + 1].first_node : stage.nodes.size();
+					for(int node_index = first_node;node_index < last_node;node_index++){
+						const Node &node = stage.nodes[node_index];
+						FeatureNode &feature_node = stage.feature_nodes[node_index];
+						feature_node.feature = -1;
+						feature_node.threshold = node.threshold;
+						feature_node.child = node.child;
+						if(node.child < 0){
+							continue;
+						}
+						std::vector<double> key = {node.a_x, node.a_y, node.b_x, node.b_y, node.box_radius, (double)node.type};
+						auto found = feature_indices.find(key);
+						if(found == feature_indices.end()){
+							int feature_index = stage.features.size() - first_feature;
+							found = feature_indices.insert(std::make_pair(key, feature_index)).first;
+							Feature feature;
+							feature.a_x = node.a_x;
+							feature.a_y = node.a_y;
+							feature.b_x = node.b_x;
+							feature.b_y = node.b_y;
+							feature.box_radius = node.box_radius;
+							feature.type = node.type;
+							stage.features.push_back(feature);
+						}
+						feature_node.feature = found->second;
+					}
+				}
+				stage.feature_offsets.push_back(stage.features.size());
+			}
+			// pixel features are read through the sampler unless the stage uses box features or mixes types
+			stage.sampler.clear();
+			stage.sampler.set_bilinear(stage.features.empty() == false && stage.features[0].type == BILINEAR_FEATURE);
+			for(const Feature &feature: stage.features){
+				if(feature.type != stage.features[0].type || feature.type == BOX_FEATURE){
+					stage.sampler.clear();
+					break;
+				}
+				stage.sampler.add_feature(feature.a_x, feature.a_y, feature.b_x, feature.b_y);
+			}
+		}
+		void Engine::set_num_stages(int num_stages){
+			_num_stages = std::min(num_stages, (int)_stages.size());
+		}
+		int Engine::get_num_landmarks() const {
+			return _num_landmarks;
+		}
+		int Engine::get_num_pyramid_levels() const {
+			int num_levels = 1;
+			for(int stage_index = 0;stage_index < _num_stages;stage_index++){
+				num_levels = std::max(num_levels, _stages[stage_index].pyramid_level + 1);
+			}
+			return num_levels;
+		}
+		bool Engine::use_box_features() const {
+			for(int stage_index = 0;stage_index < _num_stages;stage_index++){
+				for(const Node &node: _stages[stage_index].nodes){
+					if(node.child >= 0 && node.type == BOX_FEATURE){
+						return true;
+					}
+				}
+			}
+			return false;
+		}
+		// files without bilinear features are written as version 1, which older engines still read
+		static int get_format_version(const std::vector<Stage> &stages){
+			for(const Stage &stage: stages){
+				for(const Node &node: stage.nodes){
+					if(node.child >= 0 && node.type == BILINEAR_FEATURE){
+						return FORMAT_VERSION;
+					}
+				}
+			}
+			return 1;
+		}
+		// flushes a written file to the disk, like the journal does before it renames a file
+		static bool sync_file(const std::string &filename){
+#ifdef LBF_INFER_MMAP
+			int descriptor = ::open(filename.c_str(), O_RDONLY);
+			if(descriptor < 0){
+				return false;
+			}
+			bool success = fsync(descriptor) == 0;
+			close(descriptor);
+			return success;
+#else
+			return true;
+#endif
+		}
+		// written to a temporary file that is synced and renamed over the target, so a crash never leaves a partial model
+		bool Engine::save(const std::string &filename) const {
+			std::string temporary_filename = filename + ".tmp";
+			std::ofstream ofs(temporary_filename, std::ios::binary);
+			if(ofs.good() == false){
+				return false;
+			}
+			ofs.write(MAGIC, sizeof(MAGIC));
+			write_value(ofs, get_format_version(_stages));
+			write_value(ofs, _num_stages);
+			write_value(ofs, _num_landmarks);
+			write_vector(ofs, _mean_shape);
+			int num_stages = _stages.size();
+			write_value(ofs, num_stages);
+			for(const Stage &stage: _stages){
+				int trained = stage.trained;
+				write_value(ofs, trained);
+				write_value(ofs, stage.pyramid_level);
+				write_value(ofs, stage.num_leaves);
+				write_vector(ofs, stage.tree_offsets);
+				write_vector(ofs, stage.trees);
+				write_vector(ofs, stage.nodes);
+				int num_weights = stage.get_num_weights();
+				write_value(ofs, num_weights);
+				ofs.write(reinterpret_cast<const char*>(stage.get_weights()), sizeof(float) * num_weights);
+			}
+			ofs.close();
+			if(ofs.fail() || sync_file(temporary_filename) == false){
+				std::remove(temporary_filename.c_str());
+				return false;
+			}
+			return std::rename(temporary_filename.c_str(), filename.c_str()) == 0;
+		}
+		bool Engine::load(const std::string &filename){
+			std::ifstream ifs(filename, std::ios::binary);
+			if(ifs.good() == false){
+				return false;
+			}
+			return load(ifs);
+		}
+		bool Engine::load(std::istream &ifs){
+			return _load(ifs, NULL);
+		}
+		bool Engine::map(const std::string &filename){
+			std::shared_ptr<MappedFile> mapped_file(new MappedFile);
+			if(mapped_file->open(filename) == false){
+				return load(filename);
+			}
+			MemoryBuffer buffer(mapped_file->_data, mapped_file->_size);
+			std::istream stream(&buffer);
+			if(_load(stream, mapped_file.get()) == false){
+				return false;
+			}
+			_mapped_file = mapped_file;
+			return true;
+		}
+		// returns false on a truncated or inconsistent model and leaves the engine empty.
+		// with a mapped file the stream reads the same file and the regression tables are skipped instead of copied.
+		bool Engine::_load(std::istream &ifs, const MappedFile* mapped_file){
+			_stages.clear();
+			_mapped_file.reset();
+			_num_stages = 0;
+			char magic[4];
+			ifs.read(magic, sizeof(magic));
+			if(ifs.good() == false || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0){
+				return false;
+			}
+			int format_version = 0;
+			int num_applied_stages = 0;
+			int num_stages = 0;
+			int num_landmarks = 0;
+			if(read_value(ifs, format_version) == false || format_version < 1 || format_version > FORMAT_VERSION){
+				return false;
+			}
+			if(read_value(ifs, num_applied_stages) == false || read_value(ifs, num_landmarks) == false || num_landmarks <= 0){
+				return false;
+			}
+			if(read_vector(ifs, _mean_shape, (size_t)num_landmarks * 2) == false || _mean_shape.size() != (size_t)num_landmarks * 2){
+				return false;
+			}
+			// a stage takes at least its 3 values and the sizes of its 4 vectors
+			if(read_value(ifs, num_stages) == false || num_stages < 0 || (size_t)num_stages > get_remaining_size(ifs) / (7 * sizeof(int))){
+				return false;
+			}
+			_num_landmarks = num_landmarks;
+			std::vector<Stage> stages(num_stages);
+			for(int stage_index = 0;stage_index < num_stages;stage_index++){
+				Stage &stage = stages[stage_index];
+				int trained = 0;
+				if(read_value(ifs, trained) == false || read_value(ifs, stage.pyramid_level) == false || read_value(ifs, stage.num_leaves) == false){
+					return false;
+				}
+				if(read_vector(ifs, stage.tree_offsets) == false || read_vector(ifs, stage.trees) == false || read_vector(ifs, stage.nodes) == false){
+					return false;
+				}
+				if(mapped_file == NULL){
+					if(read_vector(ifs, stage.weights) == false){
+						return false;
+					}
+				}else{
+					int num_weights = 0;
+					if(read_value(ifs, num_weights) == false || num_weights < 0){
+						return false;
+					}
+					size_t offset = ifs.tellg();
+					if(offset % sizeof(float) != 0 || offset + sizeof(float) * num_weights > mapped_file->_size){
+						return false;
+					}
+					stage.mapped_weights = reinterpret_cast<const float*>(mapped_file->_data + offset);
+					stage.num_mapped_weights = num_weights;
+					ifs.seekg(sizeof(float) * num_weights, std::ios::cur);
+				}
+				if(trained == 0){
+					continue;
+				}
+				if(_validate_stage(stage) == false){
+					return false;
+				}
+				_finish_stage(stage);
+			}
+			_stages.swap(stages);
+			_num_stages = std::max(0, std::min(num_applied_stages, num_stages));
+			return true;
+		}
+		// bounds of every index the traversal follows
+		bool Engine::_validate_stage(const Stage &stage) const {
+			if(stage.pyramid_level < 0 || stage.pyramid_level > 30 || stage.num_leaves < 0){
+				return false;
+			}
+			if(stage.get_num_weights() != (size_t)stage.num_leaves * _num_landmarks * 2){
+				return false;
+			}
+			if(stage.tree_offsets.size() != _num_landmarks + 1 || stage.tree_offsets.front() != 0 || stage.tree_offsets.back() != stage.trees.size()){
+				return false;
+			}
+			for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
+				if(stage.tree_offsets[landmark_index] > stage.tree_offsets[landmark_index + 1]){
+					return false;
+				}
+			}
+			int num_nodes = stage.nodes.size();
+			for(int tree_index = 0;tree_index < stage.trees.size();tree_index++){
+				const Tree &tree = stage.trees[tree_index];
+				int last_node = (tree_index + 1 < stage.trees.size()) ? stage.trees[tree_index + 1].first_node : num_nodes;
+				if(tree.first_node < 0 || tree.first_node >= last_node || last_node > num_nodes || tree.first_leaf < 0 || tree.depth < 0 || tree.depth > 20){
+					return false;
+				}
+				int tree_size = last_node - tree.first_node;
+				if(tree.depth > 0 && tree_size != (2 << tree.depth) - 1){
+					return false;
+				}
+				for(int node_index = tree.first_node;node_index < last_node;node_index++){
+					const Node &node = stage.nodes[node_index];
+					int leaf_identifier = ~node.child;
+					// children always follow their parent, which also rules out cycles
+					if(node.child >= 0 && (node.child <= node_index - tree.first_node || node.child + 1 >= tree_size)){
+						return false;
+					}
+					if(node.child < 0 && tree.first_leaf + leaf_identifier >= stage.num_leaves){
+						return false;
+					}
+					if(node.child >= 0 && node.type != PIXEL_FEATURE && node.type != BOX_FEATURE && node.type != BILINEAR_FEATURE){
+						return false;
+					}
+					// the heap traversal derives the leaf identifier from the position
+					int num_internal_nodes = (1 << tree.depth) - 1;
+					if(tree.depth > 0 && (node_index - tree.first_node < num_internal_nodes) != (node.child >= 0)){
+						return false;
+					}
+					if(tree.depth > 0 && node.child < 0 && leaf_identifier != node_index - tree.first_node - num_internal_nodes){
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+		void Engine::set_image(Workspace &workspace, const uint8_t* pixels, int width, int height, int stride) const {
+			workspace.set_image(pixels, width, height, stride, get_num_pyramid_levels(), use_box_features());
+		}
+		// differences of the features of the stage at feature_indices. pixel features are read in one batch, box features one by one.
+		static void compute_features(const Stage &stage, const std::vector<int> &feature_indices, double landmark_x, double landmark_y,
+									 const ImageView &image, const IntegralView &integral, std::vector<int> &differences)
+		{
+			int num_indices = feature_indices.size();
+			differences.resize(num_indices);
+			if(stage.sampler.get_num_features() > 0){
+				stage.sampler.compute(image, landmark_x, landmark_y, feature_indices.data(), num_indices, differences.data());
+				return;
+			}
+			for(int index = 0;index < num_indices;index++){
+				const Feature &feature = stage.features[feature_indices[index]];
+				differences[index] = compute_feature(image, integral, landmark_x, landmark_y,
+													 feature.a_x, feature.a_y, feature.b_x, feature.b_y, feature.type, feature.box_radius);
+			}
+		}
+		// all trees of the forest descend one level at a time and the features of every tree at a level are read in one batch.
+		// the reached leaves are appended to workspace._leaf_indices as rows of the regression table.
+		void Engine::_predict_forest(const Stage &stage, int landmark_index, double landmark_x, double landmark_y,
+									 const ImageView &image, const IntegralView &integral, Workspace &workspace) const
+		{
+			int first_tree = stage.tree_offsets[landmark_index];
+			int num_trees = stage.tree_offsets[landmark_index + 1] - first_tree;
+			int first_feature = stage.feature_offsets[landmark_index];
+			const Tree* trees = stage.trees.data() + first_tree;
+			const FeatureNode* nodes = stage.feature_nodes.data();
+			std::vector<int> &node_indices = workspace._node_indices;
+			std::vector<int> &leaf_indices = workspace._leaf_indices;
+			std::vector<int> &feature_indices = workspace._feature_indices;
+			std::vector<int> &differences = workspace._differences;
+			node_indices.assign(num_trees, 0);
+
+			// complete trees : branch-free descent of a fixed number of levels in heap order
+			int depth = stage.forest_depths[landmark_index];
+			if(depth > 0){
+				feature_indices.resize(num_trees);
+				for(int tree_depth = 0;tree_depth < depth;tree_depth++){
+					for(int tree_index = 0;tree_index < num_trees;tree_index++){
+						const FeatureNode &node = nodes[trees[tree_index].first_node + node_indices[tree_index]];
+						feature_indices[tree_index] = first_feature + node.feature;
+					}
+					compute_features(stage, feature_indices, landmark_x, landmark_y, image, integral, differences);
+					for(int tree_index = 0;tree_index < num_trees;tree_index++){
+						int node_index = node_indices[tree_index];
+						const FeatureNode &node = nodes[trees[tree_index].first_node + node_index];
+						node_indices[tree_index] = node_index * 2 + 1 + (differences[tree_index] >= node.threshold);
+					}
+				}
+				int num_internal_nodes = (1 << depth) - 1;
+				for(int tree_index = 0;tree_index < num_trees;tree_index++){
+					leaf_indices.push_back(trees[tree_index].first_leaf + node_indices[tree_index] - num_internal_nodes);
+				}
+				return;
+			}
+
+			std::vector<int> &active_trees = workspace._active_trees;		// trees that have not reached a leaf
+			while(true){
+				active_trees.clear();
+				feature_indices.clear();
+				for(int tree_index = 0;tree_index < num_trees;tree_index++){
+					const FeatureNode &node = nodes[trees[tree_index].first_node + node_indices[tree_index]];
+					if(node.child < 0){
+						continue;
+					}
+					active_trees.push_back(tree_index);
+					feature_indices.push_back(first_feature + node.feature);
+				}
+				if(active_trees.empty()){
+					break;
+				}
+				compute_features(stage, feature_indices, landmark_x, landmark_y, image, integral, differences);
+				// select children
+				for(int active_index = 0;active_index < active_trees.size();active_index++){
+					int tree_index = active_trees[active_index];
+					const FeatureNode &node = nodes[trees[tree_index].first_node + node_indices[tree_index]];
+					node_indices[tree_index] = node.child + (differences[active_index] >= node.threshold);
+				}
+			}
+			for(int tree_index = 0;tree_index < num_trees;tree_index++){
+				const FeatureNode &leaf = nodes[trees[tree_index].first_node + node_indices[tree_index]];
+				assert(leaf.child < 0);
+				leaf_indices.push_back(trees[tree_index].first_leaf + ~leaf.child);
+			}
+		}
+		// local binary features of all landmarks followed by the global regression.
+		// every reached leaf adds its row of the leaf-major table to the shape increment.
+		void Engine::estimate_shape_at_stage(int stage_index, const Transform &transform, double* shape, Workspace &workspace) const {
+			assert(stage_index < _stages.size());
+			const Stage &stage = _stages[stage_index];
+			assert(stage.trained);
+			assert(stage.pyramid_level < workspace._levels.size());
+			const ImageView &image = workspace._levels[stage.pyramid_level];
+			const IntegralView &integral = workspace._integrals[stage.pyramid_level];
+			int num_columns = _num_landmarks * 2;
+
+			// shape in the coordinates of the image
+			std::vector<double> &projected_shape = workspace._projected_shape;
+			projected_shape.resize(num_columns);
+			const double* rotation = transform.rotation;
+			for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
+				double x = shape[landmark_index * 2 + 0];
+				double y = shape[landmark_index * 2 + 1];
+				projected_shape[landmark_index * 2 + 0] = rotation[0] * x + rotation[1] * y + transform.shift[0];
+				projected_shape[landmark_index * 2 + 1] = rotation[2] * x + rotation[3] * y + transform.shift[1];
+			}
+
+			// find leaves of all forests first so that the traversal of each landmark does not wait for the accumulation
+			workspace._leaf_indices.clear();
+			for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
+				double landmark_x = projected_shape[landmark_index * 2 + 0];
+				double landmark_y = projected_shape[landmark_index * 2 + 1];
+				_predict_forest(stage, landmark_index, landmark_x, landmark_y, image, integral, workspace);
+			}
+
+			// accumulate
+			std::vector<double> &delta_shape = workspace._delta_shape;
+			delta_shape.assign(num_columns, 0);
+			double* delta = delta_shape.data();
+			const float* weights = stage.get_weights();
+			for(int leaf_index: workspace._leaf_indices){
+				assert(leaf_index < stage.num_leaves);
+				const float* row = weights + leaf_index * num_columns;
+				for(int column = 0;column < num_columns;column++){
+					delta[column] += row[column];
+				}
+			}
+			for(int column = 0;column < num_columns;column++){
+				shape[column] += delta[column];
+			}
+		}
+		void Engine::estimate_shape(const Transform &transform, double* shape, Workspace &workspace) const {
+			estimate_shape(transform, shape, workspace, EarlyExit());
+		}
+		int Engine::estimate_shape(const Transform &transform, double* shape, Workspace &workspace, const EarlyExit &early_exit) const {
+			auto start = std::chrono::steady_clock::now();
+			int num_stages_run = 0;
+			for(int stage_index = 0;stage_index < _num_stages;stage_index++){
+				if(_stages[stage_index].trained == false){
+					continue;
+				}
+				estimate_shape_at_stage(stage_index, transform, shape, workspace);
+				num_stages_run++;
+				if(early_exit.tolerance > 0){
+					// estimate_shape_at_stage leaves the update of the stage in the workspace
+					const std::vector<double> &delta_shape = workspace._delta_shape;
+					double displacement = 0;
+					for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
+						double delta_x = delta_shape[landmark_index * 2 + 0];
+						double delta_y = delta_shape[landmark_index * 2 + 1];
+						displacement += std::sqrt(delta_x * delta_x + delta_y * delta_y);
+					}
+					if(displacement < early_exit.tolerance){
+						break;
+					}
+				}
+				if(early_exit.budget > 0){
+					double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+					if(elapsed >= early_exit.budget){
+						break;
+					}
+				}
+			}
+			return num_stages_run;
+		}
+		void Engine::estimate_shape(const uint8_t* pixels, int width, int height, int stride, double* shape, Workspace &workspace) const {
+			estimate_shape(pixels, width, height, stride, shape, workspace, EarlyExit());
+		}
+		// the budget includes building the pyramid and the integral images
+		int Engine::estimate_shape(const uint8_t* pixels, int width, int height, int stride, double* shape, Workspace &workspace,
+								   const EarlyExit &early_exit) const
+		{
+			auto start = std::chrono::steady_clock::now();
+			set_image(workspace, pixels, width, height, stride);
+			std::copy(_mean_shape.begin(), _mean_shape.end(), shape);
+			EarlyExit remaining = early_exit;
+			if(early_exit.budget > 0){
+				double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+				remaining.budget = std::max(early_exit.budget - elapsed, 1e-3);
+			}
+			return estimate_shape(Transform(), shape, workspace, remaining);
+		}
+		bool Engine::estimate_shape_in_box(const uint8_t* pixels, int width, int height, int stride,
+										   int left, int top, int right, int bottom, double* shape, Workspace &workspace) const
+		{
+			left = std::max(0, left);
+			top = std::max(0, top);
+			right = std::min(width, right);
+			bottom = std::min(height, bottom);
+			if(left >= right || top >= bottom){
+				return false;
+			}
+			int box_width = right - left;
+			int box_height = bottom - top;
+			estimate_shape(pixels + top * stride + left, box_width, box_height, stride, shape, workspace);
+			for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
+				double &x = shape[landmark_index * 2 + 0];
+				double &y = shape[landmark_index * 2 + 1];
+				x = left + (box_width / 2.0) + x * (box_width / 2.0);
+				y = top + (box_height / 2.0) + y * (box_height / 2.0);
+			}
+			return true;
+		}
+	}
+}
\ No newline at end of file
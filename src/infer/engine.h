@@ -0,0 +1,155 @@
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "image.h"
+#include "pixel_difference.h"
+#ifdef LBF_WITH_OPENCV
+#include <opencv2/core/core.hpp>
+#endif
+
+// inference engine of a trained cascade that only depends on the standard library.
+// the training code in lbf::python exports a model with Model::save_inference_model and the engine loads it.
+namespace lbf {
+	namespace infer {
+		struct Node {
+			double a_x;
+			double a_y;
+			double b_x;
+			double b_y;
+			double box_radius;
+			int type;
+			int threshold;
+			int child;		// >= 0 : index of the left child and the right child follows it, < 0 : ~leaf identifier
+		};
+		struct FeatureNode {
+			int feature;		// index into the features of the landmark, -1 for leaves
+			int threshold;
+			int child;
+		};
+		// pixel difference of a landmark. the trees of a forest pick their splits from the same candidates of the stage,
+		// so the nodes of a forest share far fewer features than they have.
+		struct Feature {
+			double a_x;
+			double a_y;
+			double b_x;
+			double b_y;
+			double box_radius;
+			int type;
+		};
+		struct Tree {
+			int first_node;
+			int first_leaf;		// row of leaf 0 in the regression table
+			int depth;			// > 0 : complete tree stored in heap order
+		};
+		struct Stage {
+			bool trained;
+			int pyramid_level;
+			std::vector<int> tree_offsets;		// trees of landmark l are [tree_offsets[l], tree_offsets[l + 1])
+			std::vector<int> forest_depths;		// > 0 : all trees of the landmark are complete with this depth
+			std::vector<Tree> trees;
+			std::vector<Node> nodes;
+			int num_leaves;
+			std::vector<float> weights;			// (num_leaves, num_landmarks * 2) : leaf-major regression table
+			const float* mapped_weights;		// the table inside a mapped model file. NULL : the table is in weights
+			size_t num_mapped_weights;
+			// built from the nodes when the stage is finished
+			std::vector<Feature> features;			// distinct features of landmark l are [feature_offsets[l], feature_offsets[l + 1])
+			std::vector<int> feature_offsets;
+			std::vector<FeatureNode> feature_nodes;	// nodes with the index of their feature in place of its parameters
+			PixelDifferenceSampler sampler;			// all features of the stage if they are pixel features, empty otherwise
+			Stage();
+			const float* get_weights() const;
+			size_t get_num_weights() const;
+		};
+		// stops the cascade before the last stage. 0 disables a condition.
+		struct EarlyExit {
+			double tolerance;		// after a stage that moves the landmarks by less than this in total, in normalized coordinates
+			double budget;			// once this many microseconds have passed since the estimate started
+			EarlyExit();
+		};
+		// read-only mapping of a model file, shared by the copies of an engine
+		class MappedFile {
+		public:
+			const char* _data;
+			size_t _size;
+			MappedFile();
+			~MappedFile();
+			bool open(const std::string &filename);
+		};
+		// maps the normalized shape to the coordinates of the face image
+		struct Transform {
+			double rotation[4];		// row-major 2x2
+			double shift[2];
+			Transform();
+		};
+		// per-call buffers. one workspace per thread; the engine itself is only read.
+		class Workspace {
+		public:
+			std::vector<std::vector<uint8_t>> _level_buffers;
+			std::vector<std::vector<int>> _integral_buffers;
+			std::vector<ImageView> _levels;
+			std::vector<IntegralView> _integrals;
+			std::vector<double> _projected_shape;
+			std::vector<double> _delta_shape;
+			std::vector<int> _leaf_indices;
+			std::vector<int> _node_indices;
+			std::vector<int> _feature_indices;
+			std::vector<int> _differences;
+			std::vector<int> _active_trees;
+			void set_image(const uint8_t* pixels, int width, int height, int stride, int num_levels, bool integral);
+		};
+		class Engine {
+		private:
+			void _predict_forest(const Stage &stage, int landmark_index, double landmark_x, double landmark_y,
+								 const ImageView &image, const IntegralView &integral, Workspace &workspace) const;
+			bool _validate_stage(const Stage &stage) const;
+			void _finish_stage(Stage &stage) const;
+			void _build_features(Stage &stage) const;
+			bool _load(std::istream &stream, const MappedFile* mapped_file);
+		public:
+			int _num_stages;
+			int _num_landmarks;
+			std::vector<double> _mean_shape;	// (num_landmarks, 2)
+			std::vector<Stage> _stages;
+			std::shared_ptr<MappedFile> _mapped_file;
+			Engine();
+			void init(int num_stages, int num_landmarks, const double* mean_shape);
+			void finish_stage(int stage);
+			void set_num_stages(int num_stages);
+			int get_num_landmarks() const;
+			int get_num_pyramid_levels() const;
+			bool use_box_features() const;
+			bool save(const std::string &filename) const;
+			bool load(const std::string &filename);
+			bool load(std::istream &stream);
+			// same as load but the regression tables, which are most of the file, stay in a read-only mapping.
+			// only the rows the estimates reach are paged in and processes that map the same file share them.
+			// falls back to load where files can not be mapped.
+			bool map(const std::string &filename);
+			void set_image(Workspace &workspace, const uint8_t* pixels, int width, int height, int stride) const;
+			// shape is (num_landmarks, 2) in normalized coordinates and is updated in place.
+			// set_image must be called on the workspace first.
+			void estimate_shape_at_stage(int stage, const Transform &transform, double* shape, Workspace &workspace) const;
+			void estimate_shape(const Transform &transform, double* shape, Workspace &workspace) const;
+			// returns the number of stages that ran
+			int estimate_shape(const Transform &transform, double* shape, Workspace &workspace, const EarlyExit &early_exit) const;
+			// runs all stages starting from the mean shape. the image is the cropped face.
+			void estimate_shape(const uint8_t* pixels, int width, int height, int stride, double* shape, Workspace &workspace) const;
+			int estimate_shape(const uint8_t* pixels, int width, int height, int stride, double* shape, Workspace &workspace,
+							   const EarlyExit &early_exit) const;
+			// estimates the face inside the box [left, right) x [top, bottom) of a larger frame without copying any pixel.
+			// the box is clipped to the frame like a crop would be and shape receives frame pixel coordinates.
+			// returns false if nothing of the box is left.
+			bool estimate_shape_in_box(const uint8_t* pixels, int width, int height, int stride,
+									   int left, int top, int right, int bottom, double* shape, Workspace &workspace) const;
+#ifdef LBF_WITH_OPENCV
+			void estimate_shape(const cv::Mat1b &image, double* shape, Workspace &workspace) const {
+				estimate_shape(image.data, image.cols, image.rows, image.step, shape, workspace);
+			}
+#endif
+		};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "image.h"
+
+namespace lbf {
+	namespace infer {
+		static inline int reflect_101(int index, int size){
+			if(size == 1){
+				return 0;
+			}
+			while(index < 0 || index >= size){
+				if(index < 0){
+					index = -index;
+				}
+				if(index >= size){
+					index = 2 * size - 2 - index;
+				}
+			}
+			return index;
+		}
+		void pyramid_down(const ImageView &src, uint8_t* dst, int dst_stride){
+			static const int kernel[5] = {1, 4, 6, 4, 1};
+			int dst_width = (src.width + 1) / 2;
+			int dst_height = (src.height + 1) / 2;
+
+			// source column of each tap
+			std::vector<int> columns(dst_width * 5);
+			for(int x = 0;x < dst_width;x++){
+				for(int k = 0;k < 5;k++){
+					columns[x * 5 + k] = reflect_101(x * 2 + k - 2, src.width);
+				}
+			}
+
+			std::vector<int> sums(dst_width);
+			for(int y = 0;y < dst_height;y++){
+				std::fill(sums.begin(), sums.end(), 0);
+				for(int k = 0;k < 5;k++){
+					const uint8_t* row = src.pixels + reflect_101(y * 2 + k - 2, src.height) * src.stride;
+					for(int x = 0;x < dst_width;x++){
+						const int* column = &columns[x * 5];
+						int horizontal = row[column[0]] + 4 * row[column[1]] + 6 * row[column[2]] + 4 * row[column[3]] + row[column[4]];
+						sums[x] += kernel[k] * horizontal;
+					}
+				}
+				uint8_t* dst_row = dst + y * dst_stride;
+				for(int x = 0;x < dst_width;x++){
+					dst_row[x] = (sums[x] + 128) >> 8;	// kernel sums to 256
+				}
+			}
+		}
+		void integral(const ImageView &src, int* sums, int sums_stride){
+			std::fill(sums, sums + src.width + 1, 0);
+			for(int y = 0;y < src.height;y++){
+				const uint8_t* row = src.pixels + y * src.stride;
+				const int* upper = sums + y * sums_stride;
+				int* lower = sums + (y + 1) * sums_stride;
+				lower[0] = 0;
+				int row_sum = 0;
+				for(int x = 0;x < src.width;x++){
+					row_sum += row[x];
+					lower[x + 1] = upper[x + 1] + row_sum;
+				}
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,113 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace lbf {
+	namespace infer {
+		enum { PIXEL_FEATURE = 0, BOX_FEATURE = 1, BILINEAR_FEATURE = 2 };	// feature type
+
+		// 8-bit grayscale image that is not owned
+		struct ImageView {
+			const uint8_t* pixels;
+			int width;
+			int height;
+			int stride;		// bytes per row
+		};
+
+		// integral image of (height + 1) x (width + 1) sums. width and height are those of the source image.
+		struct IntegralView {
+			const int* sums;
+			int width;
+			int height;
+			int stride;		// elements per row
+		};
+
+		// address of the pixel at a feature point. both coordinates are relative to the center of the image and scaled to [-1, 1].
+		inline const uint8_t* get_pixel_address(const ImageView &image, double landmark_x, double landmark_y, double local_x, double local_y){
+			int image_height = image.height;
+			int image_width = image.width;
+			double x = local_x + landmark_x;	// [-1, 1] : origin is the center of the image
+			double y = local_y + landmark_y;
+			int pixel_x = (image_width / 2.0) + x * (image_width / 2.0);	// [0, image_width]
+			int pixel_y = (image_height / 2.0) + y * (image_height / 2.0);
+			// clip bounds
+			pixel_x = std::max(0, std::min(pixel_x, image_width - 1));
+			pixel_y = std::max(0, std::min(pixel_y, image_height - 1));
+			return image.pixels + pixel_y * image.stride + pixel_x;
+		}
+
+		// luminosity at a feature point interpolated between the 4 nearest pixel centers.
+		// the position is cut to 1/256 pixel, so the weights are 8-bit and the interpolation only uses integers.
+		inline int get_bilinear_luminosity(const ImageView &image, double landmark_x, double landmark_y, double local_x, double local_y){
+			int image_height = image.height;
+			int image_width = image.width;
+			double x = local_x + landmark_x;
+			double y = local_y + landmark_y;
+			// 1/256 pixels from the center of pixel 0
+			int fixed_x = std::floor(((image_width / 2.0) + x * (image_width / 2.0) - 0.5) * 256);
+			int fixed_y = std::floor(((image_height / 2.0) + y * (image_height / 2.0) - 0.5) * 256);
+			int weight_x = fixed_x & 255;
+			int weight_y = fixed_y & 255;
+			int left = fixed_x >> 8;
+			int top = fixed_y >> 8;
+			// clip bounds
+			int right = std::max(0, std::min(left + 1, image_width - 1));
+			int bottom = std::max(0, std::min(top + 1, image_height - 1));
+			left = std::max(0, std::min(left, image_width - 1));
+			top = std::max(0, std::min(top, image_height - 1));
+			const uint8_t* upper = image.pixels + top * image.stride;
+			const uint8_t* lower = image.pixels + bottom * image.stride;
+			int upper_sum = upper[left] * (256 - weight_x) + upper[right] * weight_x;
+			int lower_sum = lower[left] * (256 - weight_x) + lower[right] * weight_x;
+			return (upper_sum * (256 - weight_y) + lower_sum * weight_y + (1 << 15)) >> 16;
+		}
+
+		// mean luminosity of the box around a feature point, read from the integral image with four loads
+		inline int get_box_mean(const IntegralView &integral, double landmark_x, double landmark_y, double local_x, double local_y, double box_radius){
+			int image_height = integral.height;
+			int image_width = integral.width;
+			double x = local_x + landmark_x;
+			double y = local_y + landmark_y;
+			int pixel_x = (image_width / 2.0) + x * (image_width / 2.0);
+			int pixel_y = (image_height / 2.0) + y * (image_height / 2.0);
+			int half_width = box_radius * (image_width / 2.0);
+			int half_height = box_radius * (image_height / 2.0);
+			// clip bounds
+			int left = std::max(0, std::min(pixel_x - half_width, image_width - 1));
+			int right = std::max(0, std::min(pixel_x + half_width, image_width - 1));
+			int top = std::max(0, std::min(pixel_y - half_height, image_height - 1));
+			int bottom = std::max(0, std::min(pixel_y + half_height, image_height - 1));
+			const int* upper = integral.sums + top * integral.stride;
+			const int* lower = integral.sums + (bottom + 1) * integral.stride;
+			int sum = lower[right + 1] - upper[right + 1] - lower[left] + upper[left];
+			int area = (right - left + 1) * (bottom - top + 1);
+			return sum / area;
+		}
+
+		// value of a pixel difference, bilinear pixel difference or box difference feature
+		inline int compute_feature(const ImageView &image, const IntegralView &integral, double landmark_x, double landmark_y,
+								   double a_x, double a_y, double b_x, double b_y, int type, double box_radius)
+		{
+			if(type == BOX_FEATURE){
+				int mean_a = get_box_mean(integral, landmark_x, landmark_y, a_x, a_y, box_radius);
+				int mean_b = get_box_mean(integral, landmark_x, landmark_y, b_x, b_y, box_radius);
+				return mean_a - mean_b;
+			}
+			if(type == BILINEAR_FEATURE){
+				int luminosity_a = get_bilinear_luminosity(image, landmark_x, landmark_y, a_x, a_y);
+				int luminosity_b = get_bilinear_luminosity(image, landmark_x, landmark_y, b_x, b_y);
+				return luminosity_a - luminosity_b;
+			}
+			int luminosity_a = *get_pixel_address(image, landmark_x, landmark_y, a_x, a_y);
+			int luminosity_b = *get_pixel_address(image, landmark_x, landmark_y, b_x, b_y);
+			return luminosity_a - luminosity_b;
+		}
+
+		// 5x5 gaussian blur followed by dropping every other row and column.
+		// the destination has (width + 1) / 2 x (height + 1) / 2 pixels.
+		void pyramid_down(const ImageView &src, uint8_t* dst, int dst_stride);
+		void integral(const ImageView &src, int* sums, int sums_stride);
+	}
+}
\ No newline at end of file
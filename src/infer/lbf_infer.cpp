@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <cmath>
+#include <new>
+#include <sstream>
+#include <string>
+#include "engine.h"
+#include "lbf_infer.h"
+
+using lbf::infer::EarlyExit;
+using lbf::infer::Engine;
+using lbf::infer::Workspace;
+
+struct lbf_model {
+	Engine engine;
+};
+struct lbf_workspace {
+	Workspace workspace;
+};
+
+static int estimate(const lbf_model* model, lbf_workspace* workspace,
+					const uint8_t* pixels, int width, int height, int stride, double* out_xy,
+					const EarlyExit &early_exit = EarlyExit(), int* num_stages_run = NULL)
+{
+	if(pixels == NULL || out_xy == NULL || width <= 0 || height <= 0 || stride < width){
+		return LBF_ERROR_INVALID_ARGUMENT;
+	}
+	int num_stages = model->engine.estimate_shape(pixels, width, height, stride, out_xy, workspace->workspace, early_exit);
+	if(num_stages_run != NULL){
+		*num_stages_run = num_stages;
+	}
+	return LBF_OK;
+}
+
+extern "C" {
+
+lbf_model* lbf_model_open(const char* path){
+	if(path == NULL){
+		return NULL;
+	}
+	try {
+		lbf_model* model = new lbf_model;
+		if(model->engine.map(std::string(path)) == false){
+			delete model;
+			return NULL;
+		}
+		return model;
+	} catch(...) {
+		return NULL;
+	}
+}
+lbf_model* lbf_model_open_memory(const void* data, size_t size){
+	if(data == NULL){
+		return NULL;
+	}
+	try {
+		std::istringstream stream(std::string(static_cast<const char*>(data), size));
+		lbf_model* model = new lbf_model;
+		if(model->engine.load(stream) == false){
+			delete model;
+			return NULL;
+		}
+		return model;
+	} catch(...) {
+		return NULL;
+	}
+}
+void lbf_model_close(lbf_model* model){
+	delete model;
+}
+int lbf_model_num_landmarks(const lbf_model* model){
+	if(model == NULL){
+		return 0;
+	}
+	return model->engine.get_num_landmarks();
+}
+lbf_workspace* lbf_workspace_create(const lbf_model* model){
+	try {
+		return new lbf_workspace;
+	} catch(...) {
+		return NULL;
+	}
+}
+void lbf_workspace_destroy(lbf_workspace* workspace){
+	delete workspace;
+}
+int lbf_estimate(const lbf_model* model, lbf_workspace* workspace,
+				 const uint8_t* pixels, int width, int height, int stride, double* out_xy)
+{
+	if(model == NULL){
+		return LBF_ERROR_INVALID_ARGUMENT;
+	}
+	try {
+		if(workspace == NULL){
+			lbf_workspace temporary;
+			return estimate(model, &temporary, pixels, width, height, stride, out_xy);
+		}
+		return estimate(model, workspace, pixels, width, height, stride, out_xy);
+	} catch(const std::bad_alloc &) {
+		return LBF_ERROR_OUT_OF_MEMORY;
+	} catch(...) {
+		return LBF_ERROR_INTERNAL;
+	}
+}
+int lbf_estimate_early_exit(const lbf_model* model, lbf_workspace* workspace,
+							const uint8_t* pixels, int width, int height, int stride,
+							double tolerance, double budget, double* out_xy, int* num_stages_run)
+{
+	if(model == NULL || tolerance < 0 || budget < 0){
+		return LBF_ERROR_INVALID_ARGUMENT;
+	}
+	try {
+		EarlyExit early_exit;
+		early_exit.tolerance = tolerance;
+		early_exit.budget = budget;
+		if(workspace == NULL){
+			lbf_workspace temporary;
+			return estimate(model, &temporary, pixels, width, height, stride, out_xy, early_exit, num_stages_run);
+		}
+		return estimate(model, workspace, pixels, width, height, stride, out_xy, early_exit, num_stages_run);
+	} catch(const std::bad_alloc &) {
+		return LBF_ERROR_OUT_OF_MEMORY;
+	} catch(...) {
+		return LBF_ERROR_INTERNAL;
+	}
+}
+int lbf_estimate_batch(const lbf_model* model, lbf_workspace* workspace, int num_images,
+					   const uint8_t* const* pixels, const int* widths, const int* heights, const int* strides, double* out_xy)
+{
+	if(model == NULL || num_images < 0 || (num_images > 0 && (pixels == NULL || widths == NULL || heights == NULL || strides == NULL))){
+		return LBF_ERROR_INVALID_ARGUMENT;
+	}
+	try {
+		lbf_workspace temporary;
+		if(workspace == NULL){
+			workspace = &temporary;
+		}
+		int num_values = model->engine.get_num_landmarks() * 2;
+		for(int image_index = 0;image_index < num_images;image_index++){
+			int status = estimate(model, workspace, pixels[image_index], widths[image_index], heights[image_index], strides[image_index],
+								  out_xy + (size_t)image_index * num_values);
+			if(status != LBF_OK){
+				return status;
+			}
+		}
+		return LBF_OK;
+	} catch(const std::bad_alloc &) {
+		return LBF_ERROR_OUT_OF_MEMORY;
+	} catch(...) {
+		return LBF_ERROR_INTERNAL;
+	}
+}
+int lbf_estimate_in_frame(const lbf_model* model, lbf_workspace* workspace,
+						  const uint8_t* pixels, int width, int height, int stride,
+						  int num_boxes, const int* boxes, double* out_xy)
+{
+	if(model == NULL || pixels == NULL || out_xy == NULL || width <= 0 || height <= 0 || stride < width || num_boxes < 0 || (num_boxes > 0 && boxes == NULL)){
+		return LBF_ERROR_INVALID_ARGUMENT;
+	}
+	try {
+		lbf_workspace temporary;
+		if(workspace == NULL){
+			workspace = &temporary;
+		}
+		int num_values = model->engine.get_num_landmarks() * 2;
+		for(int box_index = 0;box_index < num_boxes;box_index++){
+			const int* box = boxes + box_index * 4;
+			double* shape = out_xy + (size_t)box_index * num_values;
+			if(model->engine.estimate_shape_in_box(pixels, width, height, stride, box[0], box[1], box[2], box[3], shape, workspace->workspace) == false){
+				std::fill(shape, shape + num_values, NAN);
+			}
+		}
+		return LBF_OK;
+	} catch(const std::bad_alloc &) {
+		return LBF_ERROR_OUT_OF_MEMORY;
+	} catch(...) {
+		return LBF_ERROR_INTERNAL;
+	}
+}
+const char* lbf_error_string(int status){
+	switch(status){
+		case LBF_OK:
+			return "ok";
+		case LBF_ERROR_INVALID_ARGUMENT:
+			return "invalid argument";
+		case LBF_ERROR_OUT_OF_MEMORY:
+			return "out of memory";
+		case LBF_ERROR_INTERNAL:
+			return "internal error";
+	}
+	return "unknown status";
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * C interface of the inference engine for FFI callers.
+ * every function returns a status code or NULL instead of throwing.
+ * a model is read-only after it is opened and can be shared by threads; a workspace belongs to one thread at a time.
+ * shapes are written as num_landmarks (x, y) pairs normalized to [-1, 1] with the origin at the center of the image,
+ * i.e. pixel_x = (x + 1) * width / 2.
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct lbf_model lbf_model;
+typedef struct lbf_workspace lbf_workspace;
+
+enum {
+	LBF_OK = 0,
+	LBF_ERROR_INVALID_ARGUMENT = 1,
+	LBF_ERROR_OUT_OF_MEMORY = 2,
+	LBF_ERROR_INTERNAL = 3
+};
+
+/* NULL if the file is missing or is not a valid model exported with save_inference_model.
+   the regression tables are mapped rather than read, so opening is fast and processes share them. */
+lbf_model* lbf_model_open(const char* path);
+/* same as lbf_model_open for a model that is already in memory. the buffer is copied. */
+lbf_model* lbf_model_open_memory(const void* data, size_t size);
+void lbf_model_close(lbf_model* model);
+int lbf_model_num_landmarks(const lbf_model* model);
+
+lbf_workspace* lbf_workspace_create(const lbf_model* model);
+void lbf_workspace_destroy(lbf_workspace* workspace);
+
+/* estimates the shape of an 8-bit grayscale face crop into out_xy[num_landmarks * 2].
+ * workspace may be NULL, in which case a temporary one is allocated. */
+int lbf_estimate(const lbf_model* model, lbf_workspace* workspace,
+				 const uint8_t* pixels, int width, int height, int stride, double* out_xy);
+/* same as lbf_estimate but stops after a stage that moves the landmarks by less than tolerance in total,
+ * in normalized coordinates, or once budget microseconds have passed. 0 disables a condition.
+ * num_stages_run may be NULL. */
+int lbf_estimate_early_exit(const lbf_model* model, lbf_workspace* workspace,
+							const uint8_t* pixels, int width, int height, int stride,
+							double tolerance, double budget, double* out_xy, int* num_stages_run);
+/* estimates num_images crops in order. out_xy holds num_images * num_landmarks * 2 values. */
+int lbf_estimate_batch(const lbf_model* model, lbf_workspace* workspace, int num_images,
+					   const uint8_t* const* pixels, const int* widths, const int* heights, const int* strides, double* out_xy);
+
+/* estimates the faces of num_boxes boxes of a whole frame without cropping it.
+ * boxes holds (left, top, right, bottom) pixel bounds per face, right and bottom exclusive, and is clipped to the frame.
+ * out_xy receives num_boxes * num_landmarks * 2 frame pixel coordinates; the entries of an empty box are NaN. */
+int lbf_estimate_in_frame(const lbf_model* model, lbf_workspace* workspace,
+						  const uint8_t* pixels, int width, int height, int stride,
+						  int num_boxes, const int* boxes, double* out_xy);
+
+const char* lbf_error_string(int status);
+
+#ifdef __cplusplus
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,214 @@
+#include "pixel_difference.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define LBF_INFER_AVX2
+#endif
+
+namespace lbf {
+	namespace infer {
+		typedef void (*Kernel)(const ImageView &image, double landmark_x, double landmark_y,
+							   const double* a_x, const double* a_y, const double* b_x, const double* b_y,
+							   const int* feature_indices, int num_features, int* differences);
+
+		template <bool bilinear>
+		static inline int get_luminosity(const ImageView &image, double landmark_x, double landmark_y, double local_x, double local_y){
+			if(bilinear){
+				return get_bilinear_luminosity(image, landmark_x, landmark_y, local_x, local_y);
+			}
+			return *get_pixel_address(image, landmark_x, landmark_y, local_x, local_y);
+		}
+		// feature_indices may be NULL : feature i is read for the difference i
+		template <bool bilinear>
+		static void compute_scalar(const ImageView &image, double landmark_x, double landmark_y,
+								   const double* a_x, const double* a_y, const double* b_x, const double* b_y,
+								   const int* feature_indices, int num_features, int* differences)
+		{
+			for(int index = 0;index < num_features;index++){
+				int feature_index = (feature_indices == NULL) ? index : feature_indices[index];
+				int luminosity_a = get_luminosity<bilinear>(image, landmark_x, landmark_y, a_x[feature_index], a_y[feature_index]);
+				int luminosity_b = get_luminosity<bilinear>(image, landmark_x, landmark_y, b_x[feature_index], b_y[feature_index]);
+				differences[index] = luminosity_a - luminosity_b;
+			}
+		}
+
+#ifdef LBF_INFER_AVX2
+		// image constants of the AVX2 kernels
+		struct ImageVectors {
+			__m256d half_width;
+			__m256d half_height;
+			__m256i last_x;
+			__m256i last_y;
+			__m256i stride;
+			__m256i last_index;
+		};
+		__attribute__((target("avx2")))
+		static inline __m256i combine(__m128i lower, __m128i upper){
+			return _mm256_inserti128_si256(_mm256_castsi128_si256(lower), upper, 1);
+		}
+		__attribute__((target("avx2")))
+		static inline __m256i clip(__m256i values, __m256i last){
+			return _mm256_max_epi32(_mm256_setzero_si256(), _mm256_min_epi32(values, last));
+		}
+		// same arithmetic as get_pixel_address for 8 coordinates of one axis
+		__attribute__((target("avx2")))
+		static inline __m256i get_pixel_coordinates(__m256d lower, __m256d upper, __m256d landmark, __m256d half, __m256i last){
+			lower = _mm256_add_pd(lower, landmark);
+			upper = _mm256_add_pd(upper, landmark);
+			__m128i lower_pixels = _mm256_cvttpd_epi32(_mm256_add_pd(half, _mm256_mul_pd(lower, half)));
+			__m128i upper_pixels = _mm256_cvttpd_epi32(_mm256_add_pd(half, _mm256_mul_pd(upper, half)));
+			return clip(combine(lower_pixels, upper_pixels), last);
+		}
+		// same arithmetic as get_bilinear_luminosity : 8 coordinates of one axis in 1/256 pixels
+		__attribute__((target("avx2")))
+		static inline __m256i get_fixed_coordinates(__m256d lower, __m256d upper, __m256d landmark, __m256d half){
+			__m256d center = _mm256_set1_pd(0.5);
+			__m256d scale = _mm256_set1_pd(256);
+			lower = _mm256_add_pd(lower, landmark);
+			upper = _mm256_add_pd(upper, landmark);
+			lower = _mm256_floor_pd(_mm256_mul_pd(_mm256_sub_pd(_mm256_add_pd(half, _mm256_mul_pd(lower, half)), center), scale));
+			upper = _mm256_floor_pd(_mm256_mul_pd(_mm256_sub_pd(_mm256_add_pd(half, _mm256_mul_pd(upper, half)), center), scale));
+			return combine(_mm256_cvttpd_epi32(lower), _mm256_cvttpd_epi32(upper));
+		}
+		// the gather reads 4 bytes at each index. indices past last_index read the word ending at the last pixel
+		// and shift their pixel down, so nothing after the image is touched.
+		__attribute__((target("avx2")))
+		static inline __m256i gather_pixels(const uint8_t* pixels, __m256i indices, __m256i last_index){
+			__m256i read_indices = _mm256_min_epi32(indices, last_index);
+			__m256i shifts = _mm256_slli_epi32(_mm256_sub_epi32(indices, read_indices), 3);
+			__m256i words = _mm256_i32gather_epi32(reinterpret_cast<const int*>(pixels), read_indices, 1);
+			return _mm256_and_si256(_mm256_srlv_epi32(words, shifts), _mm256_set1_epi32(0xff));
+		}
+		// luminosities of 8 feature points given by their offsets from the landmark
+		template <bool bilinear>
+		__attribute__((target("avx2")))
+		static inline __m256i get_luminosities(const ImageView &image, const ImageVectors &vectors, __m256d landmark_x, __m256d landmark_y,
+											   const __m256d (&local_x)[2], const __m256d (&local_y)[2])
+		{
+			if(bilinear == false){
+				__m256i pixel_x = get_pixel_coordinates(local_x[0], local_x[1], landmark_x, vectors.half_width, vectors.last_x);
+				__m256i pixel_y = get_pixel_coordinates(local_y[0], local_y[1], landmark_y, vectors.half_height, vectors.last_y);
+				__m256i indices = _mm256_add_epi32(_mm256_mullo_epi32(pixel_y, vectors.stride), pixel_x);
+				return gather_pixels(image.pixels, indices, vectors.last_index);
+			}
+			__m256i fixed_x = get_fixed_coordinates(local_x[0], local_x[1], landmark_x, vectors.half_width);
+			__m256i fixed_y = get_fixed_coordinates(local_y[0], local_y[1], landmark_y, vectors.half_height);
+			__m256i mask = _mm256_set1_epi32(255);
+			__m256i one = _mm256_set1_epi32(256);
+			__m256i weight_x = _mm256_and_si256(fixed_x, mask);
+			__m256i weight_y = _mm256_and_si256(fixed_y, mask);
+			__m256i left = _mm256_srai_epi32(fixed_x, 8);
+			__m256i top = _mm256_srai_epi32(fixed_y, 8);
+			// clip bounds
+			__m256i right = clip(_mm256_add_epi32(left, _mm256_set1_epi32(1)), vectors.last_x);
+			__m256i bottom = clip(_mm256_add_epi32(top, _mm256_set1_epi32(1)), vectors.last_y);
+			left = clip(left, vectors.last_x);
+			top = clip(top, vectors.last_y);
+			__m256i upper = _mm256_mullo_epi32(top, vectors.stride);
+			__m256i lower = _mm256_mullo_epi32(bottom, vectors.stride);
+			__m256i upper_left = gather_pixels(image.pixels, _mm256_add_epi32(upper, left), vectors.last_index);
+			__m256i upper_right = gather_pixels(image.pixels, _mm256_add_epi32(upper, right), vectors.last_index);
+			__m256i lower_left = gather_pixels(image.pixels, _mm256_add_epi32(lower, left), vectors.last_index);
+			__m256i lower_right = gather_pixels(image.pixels, _mm256_add_epi32(lower, right), vectors.last_index);
+			__m256i inverse_weight_x = _mm256_sub_epi32(one, weight_x);
+			__m256i upper_sum = _mm256_add_epi32(_mm256_mullo_epi32(upper_left, inverse_weight_x), _mm256_mullo_epi32(upper_right, weight_x));
+			__m256i lower_sum = _mm256_add_epi32(_mm256_mullo_epi32(lower_left, inverse_weight_x), _mm256_mullo_epi32(lower_right, weight_x));
+			__m256i sum = _mm256_add_epi32(_mm256_mullo_epi32(upper_sum, _mm256_sub_epi32(one, weight_y)), _mm256_mullo_epi32(lower_sum, weight_y));
+			return _mm256_srai_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(1 << 15)), 16);
+		}
+		template <bool bilinear>
+		__attribute__((target("avx2")))
+		static void compute_avx2(const ImageView &image, double landmark_x, double landmark_y,
+								 const double* a_x, const double* a_y, const double* b_x, const double* b_y,
+								 const int* feature_indices, int num_features, int* differences)
+		{
+			int last_index = (image.height - 1) * image.stride + image.width - 4;
+			if(last_index < 0){
+				compute_scalar<bilinear>(image, landmark_x, landmark_y, a_x, a_y, b_x, b_y, feature_indices, num_features, differences);
+				return;
+			}
+			ImageVectors vectors;
+			vectors.half_width = _mm256_set1_pd(image.width / 2.0);
+			vectors.half_height = _mm256_set1_pd(image.height / 2.0);
+			vectors.last_x = _mm256_set1_epi32(image.width - 1);
+			vectors.last_y = _mm256_set1_epi32(image.height - 1);
+			vectors.stride = _mm256_set1_epi32(image.stride);
+			vectors.last_index = _mm256_set1_epi32(last_index);
+			__m256d landmark_x_vector = _mm256_set1_pd(landmark_x);
+			__m256d landmark_y_vector = _mm256_set1_pd(landmark_y);
+
+			int index = 0;
+			for(;index + 8 <= num_features;index += 8){
+				__m256d offsets[4][2];		// a_x, a_y, b_x, b_y of the lower and upper 4 features
+				const double* sources[4] = {a_x, a_y, b_x, b_y};
+				for(int k = 0;k < 4;k++){
+					if(feature_indices == NULL){
+						offsets[k][0] = _mm256_loadu_pd(sources[k] + index);
+						offsets[k][1] = _mm256_loadu_pd(sources[k] + index + 4);
+					}else{
+						offsets[k][0] = _mm256_i32gather_pd(sources[k], _mm_loadu_si128(reinterpret_cast<const __m128i*>(feature_indices + index)), 8);
+						offsets[k][1] = _mm256_i32gather_pd(sources[k], _mm_loadu_si128(reinterpret_cast<const __m128i*>(feature_indices + index + 4)), 8);
+					}
+				}
+				__m256i luminosity_a = get_luminosities<bilinear>(image, vectors, landmark_x_vector, landmark_y_vector, offsets[0], offsets[1]);
+				__m256i luminosity_b = get_luminosities<bilinear>(image, vectors, landmark_x_vector, landmark_y_vector, offsets[2], offsets[3]);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(differences + index), _mm256_sub_epi32(luminosity_a, luminosity_b));
+			}
+			if(feature_indices == NULL){
+				compute_scalar<bilinear>(image, landmark_x, landmark_y, a_x + index, a_y + index, b_x + index, b_y + index, NULL, num_features - index, differences + index);
+			}else{
+				compute_scalar<bilinear>(image, landmark_x, landmark_y, a_x, a_y, b_x, b_y, feature_indices + index, num_features - index, differences + index);
+			}
+		}
+#endif
+
+		static bool has_avx2(){
+#ifdef LBF_INFER_AVX2
+			return __builtin_cpu_supports("avx2");
+#else
+			return false;
+#endif
+		}
+		static Kernel get_kernel(bool bilinear){
+			static const bool avx2 = has_avx2();
+#ifdef LBF_INFER_AVX2
+			if(avx2){
+				return bilinear ? compute_avx2<true> : compute_avx2<false>;
+			}
+#endif
+			return bilinear ? compute_scalar<true> : compute_scalar<false>;
+		}
+
+		PixelDifferenceSampler::PixelDifferenceSampler(){
+			_bilinear = false;
+		}
+		void PixelDifferenceSampler::set_bilinear(bool bilinear){
+			_bilinear = bilinear;
+		}
+		void PixelDifferenceSampler::clear(){
+			_a_x.clear();
+			_a_y.clear();
+			_b_x.clear();
+			_b_y.clear();
+		}
+		void PixelDifferenceSampler::add_feature(double a_x, double a_y, double b_x, double b_y){
+			_a_x.push_back(a_x);
+			_a_y.push_back(a_y);
+			_b_x.push_back(b_x);
+			_b_y.push_back(b_y);
+		}
+		int PixelDifferenceSampler::get_num_features() const {
+			return _a_x.size();
+		}
+		void PixelDifferenceSampler::compute(const ImageView &image, double landmark_x, double landmark_y, int* differences) const {
+			get_kernel(_bilinear)(image, landmark_x, landmark_y, _a_x.data(), _a_y.data(), _b_x.data(), _b_y.data(), NULL, get_num_features(), differences);
+		}
+		void PixelDifferenceSampler::compute(const ImageView &image, double landmark_x, double landmark_y,
+											 const int* feature_indices, int num_indices, int* differences) const
+		{
+			get_kernel(_bilinear)(image, landmark_x, landmark_y, _a_x.data(), _a_y.data(), _b_x.data(), _b_y.data(), feature_indices, num_indices, differences);
+		}
+		bool PixelDifferenceSampler::uses_avx2(){
+			return has_avx2();
+		}
+	}
+}
\ No newline at end of file
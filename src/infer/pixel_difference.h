@@ -0,0 +1,31 @@
+#pragma once
+#include <vector>
+#include "image.h"
+
+namespace lbf {
+	namespace infer {
+		// pixel differences of many features around one landmark at once.
+		// training and inference both sample through it, so both read the same pixels.
+		// the kernel is picked at run time : AVX2 where the cpu has it, otherwise scalar code with the same arithmetic.
+		class PixelDifferenceSampler {
+		public:
+			bool _bilinear;		// features of BILINEAR_FEATURE instead of PIXEL_FEATURE
+			// offsets of feature i from the landmark in [-1, 1] coordinates
+			std::vector<double> _a_x;
+			std::vector<double> _a_y;
+			std::vector<double> _b_x;
+			std::vector<double> _b_y;
+			PixelDifferenceSampler();
+			void set_bilinear(bool bilinear);
+			void clear();
+			void add_feature(double a_x, double a_y, double b_x, double b_y);
+			int get_num_features() const;
+			// differences[i] is the difference of feature i
+			void compute(const ImageView &image, double landmark_x, double landmark_y, int* differences) const;
+			// differences[i] is the difference of feature feature_indices[i]
+			void compute(const ImageView &image, double landmark_x, double landmark_y,
+						 const int* feature_indices, int num_indices, int* differences) const;
+			static bool uses_avx2();
+		};
+	}
+}
\ No newline at end of file
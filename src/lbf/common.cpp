@@ -30,10 +30,14 @@ namespace lbf {
 	FeatureLocation::FeatureLocation(cv::Point2d _a, cv::Point2d _b){
 		a = _a;
 		b = _b;
+		type = PIXEL_FEATURE;
+		box_radius = 0;
 	}
 	FeatureLocation::FeatureLocation(){
 		a = cv::Point2d(0.0, 0.0);
 		b = cv::Point2d(0.0, 0.0);
+		type = PIXEL_FEATURE;
+		box_radius = 0;
 	};
 
 	namespace utils {
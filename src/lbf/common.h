@@ -1,6 +1,7 @@
 #pragma once
 #include <boost/python/numpy.hpp>
 #include <opencv2/opencv.hpp>
+#include "../infer/image.h"
 
 namespace cv {
 	cv::Mat1d point_to_mat(cv::Point2d point);
@@ -14,10 +15,15 @@ namespace boost {
 }
 
 namespace lbf {
+	using infer::PIXEL_FEATURE;
+	using infer::BOX_FEATURE;
+	using infer::BILINEAR_FEATURE;
 	class FeatureLocation {
 	public:
 		cv::Point2d a;
 		cv::Point2d b;
+		int type;
+		double box_radius;		// half size of the boxes of BOX_FEATURE in [-1, 1] coordinates
 		FeatureLocation(cv::Point2d _a, cv::Point2d _b);
 		FeatureLocation();
 	};
@@ -0,0 +1,53 @@
+#include <cassert>
+#include "face_image.h"
+
+namespace lbf {
+	FaceImage::FaceImage(cv::Mat1b &image, int num_levels, bool integral){
+		assert(num_levels > 0);
+		_levels.reserve(num_levels);
+		_levels.push_back(image);	// no copy
+		for(int level = 1;level < num_levels;level++){
+			cv::Mat1b &previous = _levels.back();
+			cv::Mat1b downsampled((previous.rows + 1) / 2, (previous.cols + 1) / 2);
+			infer::ImageView view = {previous.data, previous.cols, previous.rows, (int)previous.step};
+			infer::pyramid_down(view, downsampled.data, downsampled.step);	// gaussian blur and downsample
+			_levels.push_back(downsampled);
+		}
+		if(integral){
+			_integrals.resize(num_levels);
+			for(int level = 0;level < num_levels;level++){
+				cv::Mat1b &source = _levels[level];
+				cv::Mat_<int> &sums = _integrals[level];
+				sums = cv::Mat_<int>(source.rows + 1, source.cols + 1);
+				infer::ImageView view = {source.data, source.cols, source.rows, (int)source.step};
+				infer::integral(view, sums.ptr<int>(0), sums.step / sizeof(int));
+			}
+		}
+		for(int level = 0;level < num_levels;level++){
+			cv::Mat1b &source = _levels[level];
+			infer::ImageView view = {source.data, source.cols, source.rows, (int)source.step};
+			infer::IntegralView integral_view = {NULL, source.cols, source.rows, source.cols + 1};
+			if(has_integrals()){
+				cv::Mat_<int> &sums = _integrals[level];
+				integral_view.sums = sums.ptr<int>(0);
+				integral_view.stride = sums.step / sizeof(int);
+			}
+			_level_views.push_back(view);
+			_integral_views.push_back(integral_view);
+		}
+	}
+	cv::Mat1b & FaceImage::get_level(int level){
+		assert(0 <= level && level < _levels.size());
+		return _levels[level];
+	}
+	cv::Mat_<int> & FaceImage::get_integral(int level){
+		assert(0 <= level && level < _integrals.size());
+		return _integrals[level];
+	}
+	int FaceImage::get_num_levels(){
+		return _levels.size();
+	}
+	bool FaceImage::has_integrals(){
+		return _integrals.size() > 0;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "../infer/image.h"
+#include "../infer/pixel_difference.h"
+#include "common.h"
+
+namespace lbf {
+	// a face image and its smoothed pyramid, built once per face and shared by all stages.
+	// level 0 is the original image and each level halves the resolution of the previous one.
+	// box features read the integral image of the same level.
+	// the pyramid and the features are those of the inference library so that training and inference read the same values.
+	class FaceImage {
+	public:
+		std::vector<cv::Mat1b> _levels;
+		std::vector<cv::Mat_<int>> _integrals;		// empty if no stage uses box features
+		std::vector<infer::ImageView> _level_views;
+		std::vector<infer::IntegralView> _integral_views;
+		FaceImage(){};
+		FaceImage(cv::Mat1b &image, int num_levels, bool integral = false);
+		cv::Mat1b & get_level(int level);
+		cv::Mat_<int> & get_integral(int level);
+		int get_num_levels();
+		bool has_integrals();
+		// value of the feature of a landmark at a pyramid level
+		inline int compute_feature(int level, double landmark_x, double landmark_y, const FeatureLocation &location){
+			return infer::compute_feature(_level_views[level], _integral_views[level], landmark_x, landmark_y,
+										  location.a.x, location.a.y, location.b.x, location.b.y, location.type, location.box_radius);
+		}
+		// differences of all pixel features of the sampler around a landmark at a pyramid level
+		inline void compute_pixel_differences(int level, double landmark_x, double landmark_y, const infer::PixelDifferenceSampler &sampler, int* differences){
+			sampler.compute(_level_views[level], landmark_x, landmark_y, differences);
+		}
+	};
+}
\ No newline at end of file
@@ -1,9 +1,13 @@
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 #include <locale.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 #include "linear.h"
 #include "tron.h"
 
@@ -27,6 +31,14 @@ namespace lbf {
 		#define Malloc(type,n) (type *)malloc((n)*sizeof(type))
 		#define INF HUGE_VAL
 
+		// 64-bit LCG returning 31 bits like rand(). the state belongs to the caller,
+		// so concurrent solvers neither share nor lock a generator
+		static inline int next_random(uint64_t *state)
+		{
+			*state = *state*6364136223846793005ULL + 1442695040888963407ULL;
+			return (int)(*state >> 33);
+		}
+
 		static void print_string_stdout(const char *s)
 		{
 			fputs(s,stdout);
@@ -84,6 +96,79 @@ namespace lbf {
 			}
 		};
 
+		// row operators of the dual SVR solver, which also pass the number of nonzeros of the row
+		class general_sparse_operator
+		{
+		public:
+			static double nrm2_sq(const feature_node *x, int length)
+			{
+				return sparse_operator::nrm2_sq(x);
+			}
+
+			static double dot(const double *s, const feature_node *x, int length)
+			{
+				return sparse_operator::dot(s, x);
+			}
+
+			static void axpy(const double a, const feature_node *x, int length, double *y)
+			{
+				sparse_operator::axpy(a, x, y);
+			}
+		};
+
+		// rows of binary features, where every value is 1.
+		// dot is a gather-sum of s and axpy a scatter-add of a.
+		// both paths of dot add in the same order, so they give the same result.
+		class binary_sparse_operator
+		{
+		public:
+			static double nrm2_sq(const feature_node *x, int length)
+			{
+				return length;
+			}
+
+			static double dot(const double *s, const feature_node *x, int length)
+			{
+				double sum[4] = {0, 0, 0, 0};
+				int k = 0;
+#ifdef __AVX2__
+				// only s is gathered. gathering the strided indices too was twice as slow as scalar code
+				__m256d ret = _mm256_setzero_pd();
+				for(; k+4<=length; k+=4)
+				{
+					__m128i index = _mm_setr_epi32(x[k].index, x[k+1].index, x[k+2].index, x[k+3].index);
+					ret = _mm256_add_pd(ret, _mm256_i32gather_pd(s-1, index, 8));
+				}
+				_mm256_storeu_pd(sum, ret);
+#else
+				for(; k+4<=length; k+=4)
+				{
+					sum[0] += s[x[k].index-1];
+					sum[1] += s[x[k+1].index-1];
+					sum[2] += s[x[k+2].index-1];
+					sum[3] += s[x[k+3].index-1];
+				}
+#endif
+				for(; k<length; k++)
+					sum[k%4] += s[x[k].index-1];
+				return (sum[0]+sum[1])+(sum[2]+sum[3]);
+			}
+
+			static void axpy(const double a, const feature_node *x, int length, double *y)
+			{
+				int k = 0;
+				for(; k+4<=length; k+=4)
+				{
+					y[x[k].index-1] += a;
+					y[x[k+1].index-1] += a;
+					y[x[k+2].index-1] += a;
+					y[x[k+3].index-1] += a;
+				}
+				for(; k<length; k++)
+					y[x[k].index-1] += a;
+			}
+		};
+
 		class l2r_lr_fun: public function
 		{
 		public:
@@ -977,9 +1062,10 @@ namespace lbf {
 		#define GETI(i) (0)
 		// To support weights for instances, use GETI(i) (i)
 
-		static void solve_l2r_l1l2_svr(
+		template <class row_operator>
+		static int solve_l2r_l1l2_svr(
 			const problem *prob, double *w, const parameter *param,
-			int solver_type)
+			int solver_type, uint64_t *random_state)
 		{
 			int l = prob->l;
 			double C = param->C;
@@ -997,6 +1083,7 @@ namespace lbf {
 			double Gnorm1_init = -1.0; // Gnorm1_init is initialized at the first iteration
 			double *beta = new double[l];
 			double *QD = new double[l];
+			int *length = new int[l];
 			double *y = prob->y;
 
 			// L2R_L2LOSS_SVR_DUAL
@@ -1010,22 +1097,54 @@ namespace lbf {
 				upper_bound[0] = C;
 			}
 
+			for(i=0; i<l; i++)
+			{
+				feature_node * const xi = prob->x[i];
+				length[i] = 0;
+				while(xi[length[i]].index != -1)
+					length[i]++;
+			}
+
 			// Initial beta can be set here. Note that
 			// -upper_bound <= beta[i] <= upper_bound
+			// In L2-SVM case a primal init_sol w0 is mapped to beta[i] = (y[i]-w0*x[i] -+ p)/lambda_i,
+			// which satisfies the optimality conditions for w0. An optimal w0 is then reproduced by
+			// w = sum beta[i]*x[i]. The L1-SVM conditions do not determine beta, so it starts from 0
+			bool warm_start = (param->init_sol != NULL && solver_type == L2R_L2LOSS_SVR_DUAL);
 			for(i=0; i<l; i++)
+			{
 				beta[i] = 0;
+				if(warm_start)
+				{
+					double r = y[i] - row_operator::dot(param->init_sol, prob->x[i], length[i]);
+					if(r > p)
+						beta[i] = (r-p)/lambda[GETI(i)];
+					else if(r < -p)
+						beta[i] = (r+p)/lambda[GETI(i)];
+				}
+			}
 
 			for(i=0; i<w_size; i++)
 				w[i] = 0;
 			for(i=0; i<l; i++)
 			{
 				feature_node * const xi = prob->x[i];
-				QD[i] = sparse_operator::nrm2_sq(xi);
-				sparse_operator::axpy(beta[i], xi, w);
+				QD[i] = row_operator::nrm2_sq(xi, length[i]);
+				if(beta[i] != 0)
+					row_operator::axpy(beta[i], xi, length[i], w);
 
 				index[i] = i;
 			}
 
+			// the stopping condition is relative to the violation at beta = 0,
+			// which a warm start does not pass through
+			if(warm_start)
+			{
+				Gnorm1_init = 0;
+				for(i=0; i<l; i++)
+					Gnorm1_init += max(fabs(y[i])-p, 0.0);
+			}
+
 
 			while(iter < max_iter)
 			{
@@ -1034,7 +1153,7 @@ namespace lbf {
 
 				for(i=0; i<active_size; i++)
 				{
-					int j = i+rand()%(active_size-i);
+					int j = i+next_random(random_state)%(active_size-i);
 					swap(index[i], index[j]);
 				}
 
@@ -1045,7 +1164,7 @@ namespace lbf {
 					H = QD[i] + lambda[GETI(i)];
 
 					feature_node * const xi = prob->x[i];
-					G += sparse_operator::dot(w, xi);
+					G += row_operator::dot(w, xi, length[i]);
 
 					double Gp = G+p;
 					double Gn = G-p;
@@ -1112,10 +1231,10 @@ namespace lbf {
 					d = beta[i]-beta_old;
 
 					if(d != 0)
-						sparse_operator::axpy(d, xi, w);
+						row_operator::axpy(d, xi, length[i], w);
 				}
 
-				if(iter == 0)
+				if(iter == 0 && Gnorm1_init < 0)
 					Gnorm1_init = Gnorm1_new;
 				iter++;
 				if(iter % 10 == 0)
@@ -1159,7 +1278,9 @@ namespace lbf {
 
 			delete [] beta;
 			delete [] QD;
+			delete [] length;
 			delete [] index;
+			return iter;
 		}
 
 
@@ -2110,8 +2231,10 @@ namespace lbf {
 			free(data_label);
 		}
 
-		static void train_one(const problem *prob, const parameter *param, double *w, double Cp, double Cn)
+		// returns the passes of the dual SVR solvers, 0 for the others
+		static int train_one(const problem *prob, const parameter *param, double *w, double Cp, double Cn)
 		{
+			int iter = 0;
 			//inner and outer tolerances for TRON
 			double eps = param->eps;
 			double eps_cg = 0.1;
@@ -2212,15 +2335,28 @@ namespace lbf {
 
 				}
 				case L2R_L1LOSS_SVR_DUAL:
-					solve_l2r_l1l2_svr(prob, w, param, L2R_L1LOSS_SVR_DUAL);
+				{
+					uint64_t random_state = param->seed;
+					if(prob->binary)
+						iter = solve_l2r_l1l2_svr<binary_sparse_operator>(prob, w, param, L2R_L1LOSS_SVR_DUAL, &random_state);
+					else
+						iter = solve_l2r_l1l2_svr<general_sparse_operator>(prob, w, param, L2R_L1LOSS_SVR_DUAL, &random_state);
 					break;
+				}
 				case L2R_L2LOSS_SVR_DUAL:
-					solve_l2r_l1l2_svr(prob, w, param, L2R_L2LOSS_SVR_DUAL);
+				{
+					uint64_t random_state = param->seed;
+					if(prob->binary)
+						iter = solve_l2r_l1l2_svr<binary_sparse_operator>(prob, w, param, L2R_L2LOSS_SVR_DUAL, &random_state);
+					else
+						iter = solve_l2r_l1l2_svr<general_sparse_operator>(prob, w, param, L2R_L2LOSS_SVR_DUAL, &random_state);
 					break;
+				}
 				default:
 					fprintf(stderr, "ERROR: unknown solver_type\n");
 					break;
 			}
+			return iter;
 		}
 
 		// Calculate the initial C for parameter selection
@@ -2270,15 +2406,20 @@ namespace lbf {
 				model_->nr_feature=n;
 			model_->param = *param;
 			model_->bias = prob->bias;
+			model_->nr_iter = 0;
 
 			if(check_regression_model(model_))
 			{
 				model_->w = Malloc(double, w_size);
-				for(i=0; i<w_size; i++)
-					model_->w[i] = 0;
+				if(param->init_sol != NULL)
+					for(i=0; i<w_size; i++)
+						model_->w[i] = param->init_sol[i];
+				else
+					for(i=0; i<w_size; i++)
+						model_->w[i] = 0;
 				model_->nr_class = 2;
 				model_->label = NULL;
-				train_one(prob, param, model_->w, 0, 0);
+				model_->nr_iter = train_one(prob, param, model_->w, 0, 0);
 			}
 			else
 			{
@@ -2433,6 +2574,7 @@ namespace lbf {
 				struct problem subprob;
 
 				subprob.bias = prob->bias;
+				subprob.binary = prob->binary;
 				subprob.n = prob->n;
 				subprob.l = l-(end-begin);
 				subprob.x = Malloc(struct feature_node*,subprob.l);
@@ -2503,6 +2645,7 @@ namespace lbf {
 				int j,k;
 
 				subprob[i].bias = prob->bias;
+				subprob[i].binary = prob->binary;
 				subprob[i].n = prob->n;
 				subprob[i].l = l-(end-begin);
 				subprob[i].x = Malloc(struct feature_node*,subprob[i].l);
@@ -2800,6 +2943,7 @@ namespace lbf {
 			parameter& param = model_->param;
 
 			model_->label = NULL;
+			model_->nr_iter = 0;
 
 			char *old_locale = setlocale(LC_ALL, NULL);
 			if (old_locale)
@@ -3008,8 +3152,9 @@ namespace lbf {
 				return "unknown solver type";
 
 			if(param->init_sol != NULL
-				&& param->solver_type != L2R_LR && param->solver_type != L2R_L2LOSS_SVC)
-				return "Initial-solution specification supported only for solver L2R_LR and L2R_L2LOSS_SVC";
+				&& param->solver_type != L2R_LR && param->solver_type != L2R_L2LOSS_SVC
+				&& param->solver_type != L2R_L2LOSS_SVR && param->solver_type != L2R_L2LOSS_SVR_DUAL)
+				return "Initial-solution specification supported only for solver L2R_LR, L2R_L2LOSS_SVC, L2R_L2LOSS_SVR and L2R_L2LOSS_SVR_DUAL";
 
 			return NULL;
 		}
@@ -18,6 +18,7 @@ namespace lbf {
 			double *y;
 			struct feature_node **x;
 			double bias;            /* < 0 if no bias term */
+			int binary;             /* 1 if every value is 1. the dual SVR solvers then skip the multiplications */
 		};
 
 		static const char *solver_type_table[]=
@@ -42,6 +43,7 @@ namespace lbf {
 			double* weight;
 			double p;
 			double *init_sol;
+			unsigned int seed;	/* shuffles of the dual SVR solvers. calls with the same seed give the same model */
 		};
 
 		struct model
@@ -52,6 +54,7 @@ namespace lbf {
 			double *w;
 			int *label;		/* label of each class */
 			double bias;
+			int nr_iter;	/* passes of the dual SVR solvers, 0 for the others and loaded models */
 		};
 
 		struct model* train(const struct problem *prob, const struct parameter *param);
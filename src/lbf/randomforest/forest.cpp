@@ -48,21 +48,162 @@ namespace lbf {
 				_num_total_leaves += tree->get_num_leaves();
 			}
 		}
-		void Forest::predict(cv::Mat1d &shape, cv::Mat1b &image, std::vector<Node*> &leaves){
-			leaves.clear();
-			leaves.reserve(_num_trees);
+		void Forest::predict(cv::Mat1d &shape, FaceImage &face_image, int level, std::vector<Node*> &leaves){
+			std::vector<int> leaf_identifiers;
+			predict(shape, face_image, level, leaf_identifiers);
+			leaves.resize(leaf_identifiers.size());
 			for(int tree_index = 0;tree_index < get_num_trees();tree_index++){
-				Tree* tree = _trees[tree_index];
-				Node* leaf = tree->predict(shape, image);
+				leaves[tree_index] = _trees[tree_index]->get_leaf_at(leaf_identifiers[tree_index]);
+			}
+		}
+		// differences of one feature per tree. pixel features are read in one batch, box features one by one.
+		static void compute_features(const std::vector<FeatureLocation*> &locations, FaceImage &face_image, int level,
+									 double landmark_x, double landmark_y, infer::PixelDifferenceSampler &sampler, std::vector<int> &differences)
+		{
+			int num_locations = locations.size();
+			differences.resize(num_locations);
+			// the batch needs pixel features of one type. models trained before the fill nodes kept the type of their stage mix them.
+			int type = num_locations > 0 ? locations[0]->type : BOX_FEATURE;
+			for(FeatureLocation* location: locations){
+				if(location->type != type){
+					type = BOX_FEATURE;
+				}
+			}
+			if(type == BOX_FEATURE){
+				for(int location_index = 0;location_index < num_locations;location_index++){
+					differences[location_index] = face_image.compute_feature(level, landmark_x, landmark_y, *locations[location_index]);
+				}
+				return;
+			}
+			sampler.clear();
+			// every location has this type, fill nodes included
+			sampler.set_bilinear(type == BILINEAR_FEATURE);
+			for(FeatureLocation* location: locations){
+				sampler.add_feature(location->a.x, location->a.y, location->b.x, location->b.y);
+			}
+			face_image.compute_pixel_differences(level, landmark_x, landmark_y, sampler, differences.data());
+		}
+		// all trees of the forest descend one level at a time.
+		// a single tree is a chain of dependent loads (node -> feature -> pixels -> child), so the features of every tree
+		// at a level are read in one batch, which lets the loads of different trees overlap.
+		void Forest::predict(cv::Mat1d &shape, FaceImage &face_image, int level, std::vector<int> &leaf_identifiers){
+			int num_trees = get_num_trees();
+			assert(_landmark_index < shape.rows);
+			double landmark_x = shape(_landmark_index, 0);	// [-1, 1] : origin is the center of the image
+			double landmark_y = shape(_landmark_index, 1);	// [-1, 1] : origin is the center of the image
+
+			leaf_identifiers.resize(num_trees);
+			infer::PixelDifferenceSampler sampler;
+			std::vector<FeatureLocation*> locations;
+			std::vector<int> differences;
+
+			// complete trees : branch-free descent of a fixed number of levels in heap order
+			if(is_complete()){
+				int depth = _trees[0]->get_max_depth();
+				std::vector<FeatureLocation*> feature_locations(num_trees);
+				std::vector<int*> thresholds(num_trees);
+				std::vector<int> &node_indices = leaf_identifiers;
+				for(int tree_index = 0;tree_index < num_trees;tree_index++){
+					feature_locations[tree_index] = _trees[tree_index]->get_heap_feature_locations();
+					thresholds[tree_index] = _trees[tree_index]->get_heap_pixel_difference_thresholds();
+					node_indices[tree_index] = 0;
+				}
+				locations.resize(num_trees);
+				for(int tree_depth = 0;tree_depth < depth;tree_depth++){
+					for(int tree_index = 0;tree_index < num_trees;tree_index++){
+						locations[tree_index] = &feature_locations[tree_index][node_indices[tree_index]];
+					}
+					compute_features(locations, face_image, level, landmark_x, landmark_y, sampler, differences);
+					for(int tree_index = 0;tree_index < num_trees;tree_index++){
+						int node_index = node_indices[tree_index];
+						node_index = node_index * 2 + 1 + (differences[tree_index] >= thresholds[tree_index][node_index]);
+						node_indices[tree_index] = node_index;
+						__builtin_prefetch(&feature_locations[tree_index][node_index]);
+					}
+				}
+				int num_internal_nodes = (1 << depth) - 1;
+				for(int tree_index = 0;tree_index < num_trees;tree_index++){
+					leaf_identifiers[tree_index] = node_indices[tree_index] - num_internal_nodes;
+					assert(0 <= leaf_identifiers[tree_index] && leaf_identifiers[tree_index] < _trees[tree_index]->get_num_leaves());
+				}
+				return;
+			}
+
+			std::vector<Node*> nodes(num_trees);
+			for(int tree_index = 0;tree_index < num_trees;tree_index++){
+				nodes[tree_index] = _trees[tree_index]->get_root();
+			}
+
+			std::vector<int> active_trees;		// trees that have not reached a leaf
+			while(true){
+				active_trees.clear();
+				locations.clear();
+				for(int tree_index = 0;tree_index < num_trees;tree_index++){
+					Node* node = nodes[tree_index];
+					if(node->_is_leaf){
+						continue;
+					}
+					active_trees.push_back(tree_index);
+					locations.push_back(&node->_feature_location);
+				}
+				if(active_trees.empty()){
+					break;
+				}
+				compute_features(locations, face_image, level, landmark_x, landmark_y, sampler, differences);
+				// select children
+				for(int active_index = 0;active_index < active_trees.size();active_index++){
+					int tree_index = active_trees[active_index];
+					Node* node = nodes[tree_index];
+					Node* child = (differences[active_index] < node->_pixel_difference_threshold) ? node->_left : node->_right;
+					assert(child != NULL);
+					__builtin_prefetch(&child->_is_leaf);
+					__builtin_prefetch(&child->_feature_location);
+					nodes[tree_index] = child;
+				}
+			}
+
+			for(int tree_index = 0;tree_index < num_trees;tree_index++){
+				Node* leaf = nodes[tree_index];
 				assert(leaf->is_leaf() == true);
-				assert(0 <= leaf->identifier() && leaf->identifier() < tree->get_num_leaves());
-				leaves.push_back(leaf);
+				assert(0 <= leaf->identifier() && leaf->identifier() < _trees[tree_index]->get_num_leaves());
+				leaf_identifiers[tree_index] = leaf->identifier();
+			}
+		}
+		void Forest::set_complete(bool complete){
+			for(Tree* tree: _trees){
+				tree->set_complete(complete);
+			}
+		}
+		void Forest::set_split_sampling(int num_features_per_node, int max_split_samples){
+			for(Tree* tree: _trees){
+				tree->set_split_sampling(num_features_per_node, max_split_samples);
 			}
 		}
+		// true if every tree is stored in heap order with the same depth
+		bool Forest::is_complete(){
+			if(_trees.size() == 0){
+				return false;
+			}
+			int depth = _trees[0]->get_max_depth();
+			for(Tree* tree: _trees){
+				if(tree->is_complete() == false || tree->get_max_depth() != depth){
+					return false;
+				}
+			}
+			return true;
+		}
 		Tree* Forest::get_tree_at(int tree_index){
 			assert(tree_index < _num_trees);
 			return _trees[tree_index];	
 		}
+		void Forest::remove_tree(int tree_index){
+			assert(tree_index < _num_trees);
+			Tree* tree = _trees[tree_index];
+			_num_total_leaves -= tree->get_num_leaves();
+			_trees.erase(_trees.begin() + tree_index);
+			_num_trees = _trees.size();
+			delete tree;
+		}
 		int Forest::get_num_trees(){
 			assert(_num_trees == _trees.size());
 			return _trees.size();
@@ -24,8 +24,13 @@ namespace lbf {
 			void train(std::vector<FeatureLocation> &sampled_feature_locations, 
 					   cv::Mat_<int> &pixel_differences, 
 					   std::vector<cv::Mat1d> &regression_targets);
-			void predict(cv::Mat1d &shape, cv::Mat1b &image, std::vector<Node*> &leaves);
+			void predict(cv::Mat1d &shape, FaceImage &face_image, int level, std::vector<Node*> &leaves);
+			void predict(cv::Mat1d &shape, FaceImage &face_image, int level, std::vector<int> &leaf_identifiers);
+			void set_complete(bool complete);
+			void set_split_sampling(int num_features_per_node, int max_split_samples);
+			bool is_complete();
 			Tree* get_tree_at(int tree_index);
+			void remove_tree(int tree_index);
 			int get_num_trees();
 			int get_num_total_leaves();
 			int enumerate_num_total_leaves();
@@ -1,5 +1,6 @@
 #pragma once
 #include <boost/serialization/serialization.hpp>
+#include <boost/serialization/version.hpp>
 #include <opencv2/opencv.hpp>
 #include <vector>
 #include <set>
@@ -39,11 +40,6 @@ namespace lbf {
 				_pixel_difference_threshold = 0;
 				_tree = tree;
 			};
-			bool split(std::set<int> &data_indices,
-					   std::vector<FeatureLocation> &sampled_feature_locations, 
-					   cv::Mat_<int> &pixel_differences, 
-					   std::vector<cv::Mat1d> &regression_targets,
-					   std::set<int> &_selected_feature_indices_of_all_nodes);
 			int identifier();
 			bool is_leaf();
 			void _update_delta_shape(std::vector<cv::Mat1d> &regression_targets);
@@ -51,4 +47,6 @@ namespace lbf {
 			void release_training_data();
 		};
 	}
-}
\ No newline at end of file
+}
+
+BOOST_CLASS_VERSION(lbf::randomforest::Node, 1)
\ No newline at end of file
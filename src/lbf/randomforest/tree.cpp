@@ -1,6 +1,8 @@
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/binary_oarchive.hpp>
+#include <algorithm>
 #include <iostream>
+#include "../sampler.h"
 #include "forest.h"
 
 namespace lbf {
@@ -12,99 +14,376 @@ namespace lbf {
 			_num_leaves = 0;
 			_landmark_index = landmark_index;
 			_forest = forest;
+			_complete = false;
+			_num_features_per_node = 0;
+			_max_split_samples = 0;
 		}
 		Tree::~Tree(){
 			delete _root;
 		}
+		// the tree grows one level at a time. each level makes a single pass over the rows of pixel_differences
+		// that accumulates the split statistics of all its nodes, instead of one scan of the rows per node.
 		void Tree::train(std::set<int> &data_indices,
 						 std::vector<FeatureLocation> &sampled_feature_locations, 
 						 cv::Mat_<int> &pixel_differences, 
 						 std::vector<cv::Mat1d> &regression_targets)
 		{
 			assert(data_indices.size() > 0);
-			split_node(_root, data_indices, sampled_feature_locations, pixel_differences, regression_targets);
+			int num_data = pixel_differences.cols;
+			std::vector<double> targets_x(num_data, 0);
+			std::vector<double> targets_y(num_data, 0);
+			for(int data_index: data_indices){
+				cv::Mat1d &regression_target = regression_targets[data_index];
+				targets_x[data_index] = regression_target(_landmark_index, 0);
+				targets_y[data_index] = regression_target(_landmark_index, 1);
+			}
+			std::vector<Node*> nodes(1, _root);
+			std::vector<std::set<int>*> data_indices_of_nodes(1, &data_indices);
+			while(nodes.size() > 0){
+				std::vector<Node*> next_nodes;
+				std::vector<std::set<int>*> next_data_indices_of_nodes;
+				_split_level(nodes, data_indices_of_nodes, sampled_feature_locations, pixel_differences, regression_targets, 
+							 targets_x, targets_y, next_nodes, next_data_indices_of_nodes);
+				nodes = next_nodes;
+				data_indices_of_nodes = next_data_indices_of_nodes;
+			}
+			// leaves are numbered from left to right like a depth-first growth would
+			_autoincrement_leaf_index = 0;
+			_number_leaves(_root);
+			assert(_autoincrement_leaf_index == _num_leaves);
 			_root->release_training_data();
+			build_index();
 		}
-		void Tree::split_node(Node* node, 
-							  std::set<int> &data_indices,
-							  std::vector<FeatureLocation> &sampled_feature_locations, 
-							  cv::Mat_<int> &pixel_differences, 
-							  std::vector<cv::Mat1d> &regression_targets)
+		void Tree::_split_level(std::vector<Node*> &nodes,
+								std::vector<std::set<int>*> &data_indices_of_nodes,
+								std::vector<FeatureLocation> &sampled_feature_locations, 
+								cv::Mat_<int> &pixel_differences, 
+								std::vector<cv::Mat1d> &regression_targets,
+								std::vector<double> &targets_x,
+								std::vector<double> &targets_y,
+								std::vector<Node*> &next_nodes,
+								std::vector<std::set<int>*> &next_data_indices_of_nodes)
 		{
-			assert(data_indices.size() > 0);
-			if(node->_depth > _max_depth){
-				node->mark_as_leaf(_autoincrement_leaf_index, data_indices, regression_targets);
+			int num_nodes = nodes.size();
+			int num_features = pixel_differences.rows;
+			int num_data = pixel_differences.cols;
+			if(nodes[0]->_depth > _max_depth){
+				for(int node_index = 0;node_index < num_nodes;node_index++){
+					nodes[node_index]->mark_as_leaf(_autoincrement_leaf_index, *data_indices_of_nodes[node_index], regression_targets);
+					_autoincrement_leaf_index++;
+					_num_leaves++;
+				}
+				return;
+			}
+			assert(_selected_feature_indices_of_all_nodes.size() < num_features);
+
+			// data, candidate features and random thresholds of each node.
+			// the statistics are stored per (node, feature) : only the candidates of a node are filled.
+			std::vector<int> level_data_indices;		// grouped by node
+			std::vector<int> data_offsets_of_nodes(num_nodes + 1, 0);
+			std::vector<std::vector<int>> candidates_of_nodes(num_nodes);
+			std::vector<int> thresholds(num_nodes * num_features, 0);
+			std::vector<bool> feature_is_candidate(num_features, false);
+			for(int node_index = 0;node_index < num_nodes;node_index++){
+				std::vector<int> data_indices(data_indices_of_nodes[node_index]->begin(), data_indices_of_nodes[node_index]->end());
+				assert(data_indices.size() > 0);
+
+				// the statistics of a large node are computed on a random subset of its data
+				if(_max_split_samples > 0 && _max_split_samples < data_indices.size()){
+					for(int n = 0;n < _max_split_samples;n++){
+						int k = sampler::uniform_int(n, data_indices.size() - 1);
+						std::swap(data_indices[n], data_indices[k]);
+					}
+					data_indices.resize(_max_split_samples);
+					std::sort(data_indices.begin(), data_indices.end());
+				}
+
+				// candidate features : all the features no node of the upper levels uses, or a random subset of them
+				std::vector<int> &candidates = candidates_of_nodes[node_index];
+				for(int feature_index = 0;feature_index < num_features;feature_index++){
+					if(_selected_feature_indices_of_all_nodes.find(feature_index) != _selected_feature_indices_of_all_nodes.end()){
+						continue;
+					}
+					candidates.push_back(feature_index);
+				}
+				if(_num_features_per_node > 0 && _num_features_per_node < candidates.size()){
+					for(int n = 0;n < _num_features_per_node;n++){
+						int k = sampler::uniform_int(n, candidates.size() - 1);
+						std::swap(candidates[n], candidates[k]);
+					}
+					candidates.resize(_num_features_per_node);
+				}
+
+				for(int feature_index: candidates){
+					int random_index = sampler::uniform_int(0, data_indices.size() - 1);
+					thresholds[node_index * num_features + feature_index] = pixel_differences(feature_index, data_indices[random_index]);
+					feature_is_candidate[feature_index] = true;
+				}
+				level_data_indices.insert(level_data_indices.end(), data_indices.begin(), data_indices.end());
+				data_offsets_of_nodes[node_index + 1] = level_data_indices.size();
+			}
+
+			// totals of each node and sums of the left side of each candidate split
+			std::vector<int> num_data_of_nodes(num_nodes, 0);
+			std::vector<double> sum_x_of_nodes(num_nodes, 0);
+			std::vector<double> sum_y_of_nodes(num_nodes, 0);
+			std::vector<double> sum_squares_of_nodes(num_nodes, 0);
+			for(int node_index = 0;node_index < num_nodes;node_index++){
+				for(int n = data_offsets_of_nodes[node_index];n < data_offsets_of_nodes[node_index + 1];n++){
+					int data_index = level_data_indices[n];
+					double target_x = targets_x[data_index];
+					double target_y = targets_y[data_index];
+					num_data_of_nodes[node_index] += 1;
+					sum_x_of_nodes[node_index] += target_x;
+					sum_y_of_nodes[node_index] += target_y;
+					sum_squares_of_nodes[node_index] += target_x * target_x + target_y * target_y;
+				}
+			}
+			std::vector<std::vector<bool>> is_candidate_of_nodes(num_nodes, std::vector<bool>(num_features, false));
+			for(int node_index = 0;node_index < num_nodes;node_index++){
+				for(int feature_index: candidates_of_nodes[node_index]){
+					is_candidate_of_nodes[node_index][feature_index] = true;
+				}
+			}
+			std::vector<int> num_left(num_nodes * num_features, 0);
+			std::vector<double> sum_x_left(num_nodes * num_features, 0);
+			std::vector<double> sum_y_left(num_nodes * num_features, 0);
+			std::vector<double> sum_squares_left(num_nodes * num_features, 0);
+
+			// one pass over each row for all nodes of the level. every element of the row is read once.
+			for(int feature_index = 0;feature_index < num_features;feature_index++){
+				if(feature_is_candidate[feature_index] == false){
+					continue;
+				}
+				const int* row = pixel_differences.ptr<int>(feature_index);
+				for(int node_index = 0;node_index < num_nodes;node_index++){
+					if(is_candidate_of_nodes[node_index][feature_index] == false){
+						continue;
+					}
+					int threshold = thresholds[node_index * num_features + feature_index];
+					int count = 0;
+					double sum_x = 0;
+					double sum_y = 0;
+					double sum_squares = 0;
+					for(int n = data_offsets_of_nodes[node_index];n < data_offsets_of_nodes[node_index + 1];n++){
+						int data_index = level_data_indices[n];
+						if(row[data_index] < threshold){
+							double target_x = targets_x[data_index];
+							double target_y = targets_y[data_index];
+							count += 1;
+							sum_x += target_x;
+							sum_y += target_y;
+							sum_squares += target_x * target_x + target_y * target_y;
+						}
+					}
+					int stat_index = node_index * num_features + feature_index;
+					num_left[stat_index] = count;
+					sum_x_left[stat_index] = sum_x;
+					sum_y_left[stat_index] = sum_y;
+					sum_squares_left[stat_index] = sum_squares;
+				}
+			}
+
+			// the nodes pick their split from left to right and a feature is used by one node of the level only,
+			// unless all the candidates of a node are taken
+			for(int node_index = 0;node_index < num_nodes;node_index++){
+				Node* node = nodes[node_index];
+				std::set<int> &data_indices = *data_indices_of_nodes[node_index];
+				std::vector<int> &candidates = candidates_of_nodes[node_index];
+				int selected_candidate_index = -1;
+				for(int pass = 0;pass < 2 && selected_candidate_index == -1;pass++){
+					double minimum_score = 9999999999;
+					for(int candidate_index = 0;candidate_index < candidates.size();candidate_index++){
+						int feature_index = candidates[candidate_index];
+						if(pass == 0 && _selected_feature_indices_of_all_nodes.find(feature_index) != _selected_feature_indices_of_all_nodes.end()){
+							continue;
+						}
+						// sum of squared errors of each side
+						int stat_index = node_index * num_features + feature_index;
+						double score = 0;
+						if(num_left[stat_index] > 0){
+							double sum_x = sum_x_left[stat_index];
+							double sum_y = sum_y_left[stat_index];
+							score += sum_squares_left[stat_index] - (sum_x * sum_x + sum_y * sum_y) / num_left[stat_index];
+						}
+						int num_right = num_data_of_nodes[node_index] - num_left[stat_index];
+						if(num_right > 0){
+							double sum_x = sum_x_of_nodes[node_index] - sum_x_left[stat_index];
+							double sum_y = sum_y_of_nodes[node_index] - sum_y_left[stat_index];
+							double sum_squares = sum_squares_of_nodes[node_index] - sum_squares_left[stat_index];
+							score += sum_squares - (sum_x * sum_x + sum_y * sum_y) / num_right;
+						}
+						if(score < minimum_score){
+							minimum_score = score;
+							selected_candidate_index = candidate_index;
+						}
+					}
+				}
+				assert(selected_candidate_index != -1);
+				int selected_feature_index = candidates[selected_candidate_index];
+				_selected_feature_indices_of_all_nodes.insert(selected_feature_index);
+				node->_pixel_difference_threshold = thresholds[node_index * num_features + selected_feature_index];
+				node->_feature_location = sampled_feature_locations[selected_feature_index];
+
+				for(int data_index: data_indices){
+					if(pixel_differences(selected_feature_index, data_index) < node->_pixel_difference_threshold){
+						node->_left_indices.insert(data_index);
+						continue;
+					}
+					node->_right_indices.insert(data_index);
+				}
+
+				bool need_to_split = node->_left_indices.size() > 0 && node->_right_indices.size() > 0;
+				if(need_to_split == false && _complete == false){
+					node->mark_as_leaf(_autoincrement_leaf_index, data_indices, regression_targets);
+					_autoincrement_leaf_index++;
+					_num_leaves++;
+					continue;
+				}
+				node->_is_leaf = false;
+				node->_left = new Node(node->_depth + 1, _landmark_index, this);
+				node->_right = new Node(node->_depth + 1, _landmark_index, this);
+
+				// pass-through node : the selected split sends all data to one side.
+				// the empty side is filled with the statistics of this node so that the tree stays complete.
+				if(node->_left_indices.size() == 0){
+					fill_node(node->_left, node->_feature_location, data_indices, regression_targets);
+				}else{
+					next_nodes.push_back(node->_left);
+					next_data_indices_of_nodes.push_back(&node->_left_indices);
+				}
+				if(node->_right_indices.size() == 0){
+					fill_node(node->_right, node->_feature_location, data_indices, regression_targets);
+				}else{
+					next_nodes.push_back(node->_right);
+					next_data_indices_of_nodes.push_back(&node->_right_indices);
+				}
+			}
+		}
+		void Tree::_number_leaves(Node* node){
+			if(node->_is_leaf){
+				node->_leaf_identifier = _autoincrement_leaf_index;
 				_autoincrement_leaf_index++;
-				_num_leaves++;
 				return;
 			}
-			bool need_to_split = node->split(data_indices, sampled_feature_locations, pixel_differences, regression_targets, _selected_feature_indices_of_all_nodes);
-			if(need_to_split == false){
+			_number_leaves(node->_left);
+			_number_leaves(node->_right);
+		}
+		// grow a subtree down to _max_depth whose leaves all predict the mean of data_indices.
+		// its nodes keep the feature type of the split above them, so the features of a stage stay of one type.
+		void Tree::fill_node(Node* node,
+							 const FeatureLocation &parent_location,
+							 std::set<int> &data_indices,
+							 std::vector<cv::Mat1d> &regression_targets)
+		{
+			assert(data_indices.size() > 0);
+			if(node->_depth > _max_depth){
 				node->mark_as_leaf(_autoincrement_leaf_index, data_indices, regression_targets);
 				_autoincrement_leaf_index++;
 				_num_leaves++;
 				return;
 			}
+			// the difference of a point with itself is 0 so everything goes right
 			node->_is_leaf = false;
-			assert(node->_left_indices.size() > 0);
-			assert(node->_right_indices.size() > 0);
-
+			node->_feature_location = FeatureLocation();
+			node->_feature_location.type = parent_location.type;
+			node->_feature_location.box_radius = parent_location.box_radius;
+			node->_pixel_difference_threshold = 0;
 			node->_left = new Node(node->_depth + 1, _landmark_index, this);
 			node->_right = new Node(node->_depth + 1, _landmark_index, this);
-
-			split_node(node->_left, node->_left_indices, sampled_feature_locations, pixel_differences, regression_targets);
-			split_node(node->_right, node->_right_indices, sampled_feature_locations, pixel_differences, regression_targets);
+			fill_node(node->_left, parent_location, data_indices, regression_targets);
+			fill_node(node->_right, parent_location, data_indices, regression_targets);
 		}
-		int Tree::get_num_leaves(){
-			return _num_leaves;
+		void Tree::set_complete(bool complete){
+			_complete = complete;
 		}
-		Node* Tree::predict(cv::Mat1d &shape, cv::Mat1b &image){
-			int image_height = image.rows;
-			int image_width = image.cols;
-			assert(_landmark_index < shape.rows);
-			double landmark_x = shape(_landmark_index, 0);	// [-1, 1] : origin is the center of the image
-			double landmark_y = shape(_landmark_index, 1);	// [-1, 1] : origin is the center of the image
-
-			Node* node = _root;
-
-			while(node->_is_leaf == false){
-				FeatureLocation &local_location = node->_feature_location; // [-1, 1] : origin is the landmark position
-
-				// a
-				double local_x_a = local_location.a.x + landmark_x;	// [-1, 1] : origin is the center of the image
-				double local_y_a = local_location.a.y + landmark_y;
-				int pixel_x_a = (image_width / 2.0) + local_x_a * (image_width / 2.0);	// [0, image_width]
-				int pixel_y_a = (image_height / 2.0) + local_y_a * (image_height / 2.0);
-
-				// b
-				double local_x_b = local_location.b.x + landmark_x;
-				double local_y_b = local_location.b.y + landmark_y;
-				int pixel_x_b = (image_width / 2.0) + local_x_b * (image_width / 2.0);
-				int pixel_y_b = (image_height / 2.0) + local_y_b * (image_height / 2.0);
-
-				// clip bounds
-				pixel_x_a = std::max(0, std::min(pixel_x_a, image_width - 1));
-				pixel_y_a = std::max(0, std::min(pixel_y_a, image_height - 1));
-				pixel_x_b = std::max(0, std::min(pixel_x_b, image_width - 1));
-				pixel_y_b = std::max(0, std::min(pixel_y_b, image_height - 1));
-
-				// get pixel value
-				int luminosity_a = image(pixel_y_a, pixel_x_a);
-				int luminosity_b = image(pixel_y_b, pixel_x_b);
-
-				// pixel difference feature
-				int diff = luminosity_a - luminosity_b;
-
-				// select child
-				if(diff < node->_pixel_difference_threshold){
-					assert(node->_left != NULL);
-					node = node->_left;
-					continue;
+		void Tree::set_split_sampling(int num_features_per_node, int max_split_samples){
+			assert(num_features_per_node >= 0 && max_split_samples >= 0);
+			_num_features_per_node = num_features_per_node;
+			_max_split_samples = max_split_samples;
+		}
+		int Tree::get_num_features_per_node(){
+			return _num_features_per_node;
+		}
+		int Tree::get_max_split_samples(){
+			return _max_split_samples;
+		}
+		bool Tree::is_complete(){
+			return _heap_pixel_difference_thresholds.size() > 0;
+		}
+		int Tree::get_max_depth(){
+			return _max_depth;
+		}
+		void Tree::build_index(){
+			_leaves.clear();
+			_leaves.resize(_num_leaves, NULL);
+			if(_num_leaves == 0){
+				return;		// not trained yet
+			}
+			_collect_leaves(_root);
+			_build_heap();
+		}
+		void Tree::_collect_leaves(Node* node){
+			if(node->_is_leaf){
+				assert(0 <= node->identifier() && node->identifier() < _num_leaves);
+				_leaves[node->identifier()] = node;
+				return;
+			}
+			_collect_leaves(node->_left);
+			_collect_leaves(node->_right);
+		}
+		// store the split of a complete tree in heap order.
+		// leaves are numbered from left to right, so the leaf reached from heap index i is i - (2^depth - 1).
+		void Tree::_build_heap(){
+			_heap_feature_locations.clear();
+			_heap_pixel_difference_thresholds.clear();
+			int num_leaves = 1 << _max_depth;
+			if(_num_leaves != num_leaves){
+				return;
+			}
+			for(int leaf_identifier = 0;leaf_identifier < num_leaves;leaf_identifier++){
+				if(_leaves[leaf_identifier]->_depth != _max_depth + 1){
+					return;
+				}
+			}
+			int num_internal_nodes = num_leaves - 1;
+			std::vector<FeatureLocation> feature_locations(num_internal_nodes);
+			std::vector<int> thresholds(num_internal_nodes);
+			std::vector<Node*> nodes(num_internal_nodes + num_leaves);
+			nodes[0] = _root;
+			for(int node_index = 0;node_index < num_internal_nodes;node_index++){
+				Node* node = nodes[node_index];
+				assert(node->_is_leaf == false);
+				feature_locations[node_index] = node->_feature_location;
+				thresholds[node_index] = node->_pixel_difference_threshold;
+				nodes[node_index * 2 + 1] = node->_left;
+				nodes[node_index * 2 + 2] = node->_right;
+			}
+			for(int leaf_identifier = 0;leaf_identifier < num_leaves;leaf_identifier++){
+				if(nodes[num_internal_nodes + leaf_identifier] != _leaves[leaf_identifier]){
+					return;
 				}
-				assert(node->_right != NULL);
-				node = node->_right;
 			}
-			return node;
+			_heap_feature_locations = feature_locations;
+			_heap_pixel_difference_thresholds = thresholds;
+		}
+		int Tree::get_num_leaves(){
+			return _num_leaves;
+		}
+		Node* Tree::get_root(){
+			return _root;
+		}
+		Node* Tree::get_leaf_at(int leaf_identifier){
+			assert(0 <= leaf_identifier && leaf_identifier < _leaves.size());
+			return _leaves[leaf_identifier];
+		}
+		FeatureLocation* Tree::get_heap_feature_locations(){
+			assert(is_complete());
+			return _heap_feature_locations.data();
+		}
+		int* Tree::get_heap_pixel_difference_thresholds(){
+			assert(is_complete());
+			return _heap_pixel_difference_thresholds.data();
 		}
 		int Tree::enumerate_nodes(Node* node){
 			int count = 1;
@@ -123,6 +402,16 @@ namespace lbf {
 			ar & _num_leaves;
 			ar & _landmark_index;
 			ar & _root;
+			if(version > 0){
+				ar & _complete;
+			}
+			if(version > 1){
+				ar & _num_features_per_node;
+				ar & _max_split_samples;
+			}
+			if(Archive::is_loading::value){
+				build_index();
+			}
 		}
 		template void Tree::serialize(boost::archive::binary_iarchive &ar, unsigned int version);
 		template void Tree::serialize(boost::archive::binary_oarchive &ar, unsigned int version);
@@ -1,8 +1,10 @@
 #pragma once
 #include <boost/serialization/serialization.hpp>
+#include <boost/serialization/version.hpp>
 #include <opencv2/opencv.hpp>
 #include <vector>
 #include <set>
+#include "../face_image.h"
 #include "node.h"
 
 namespace lbf {
@@ -16,26 +18,60 @@ namespace lbf {
 			int _autoincrement_leaf_index;
 			int _num_leaves;
 			int _landmark_index;
+			bool _complete;		// grow every branch to _max_depth
+			int _num_features_per_node;		// > 0 : each split only tries this many random features
+			int _max_split_samples;			// > 0 : the split statistics of larger nodes use this many random data
 			std::set<int> _selected_feature_indices_of_all_nodes;
+			std::vector<Node*> _leaves;		// indexed by leaf identifier
+			// implicit heap layout of a complete tree : children of node i are 2i+1 and 2i+2
+			std::vector<FeatureLocation> _heap_feature_locations;
+			std::vector<int> _heap_pixel_difference_thresholds;
 			friend class boost::serialization::access;
 			template <class Archive>
 			void serialize(Archive &ar, unsigned int version);
+			void _collect_leaves(Node* node);
+			void _split_level(std::vector<Node*> &nodes,
+							  std::vector<std::set<int>*> &data_indices_of_nodes,
+							  std::vector<FeatureLocation> &sampled_feature_locations, 
+							  cv::Mat_<int> &pixel_differences, 
+							  std::vector<cv::Mat1d> &regression_targets,
+							  std::vector<double> &targets_x,
+							  std::vector<double> &targets_y,
+							  std::vector<Node*> &next_nodes,
+							  std::vector<std::set<int>*> &next_data_indices_of_nodes);
+			void _number_leaves(Node* node);
+			void _build_heap();
 		public:
-			Tree(){};
+			Tree(){
+				_complete = false;
+				_num_features_per_node = 0;
+				_max_split_samples = 0;
+			};
 			~Tree();
 			Tree(int max_depth, int landmark_index, Forest* forest);
 			void train(std::set<int> &data_indices,
 					   std::vector<FeatureLocation> &sampled_feature_locations, 
 					   cv::Mat_<int> &pixel_differences, 
 					   std::vector<cv::Mat1d> &regression_targets);
-			void split_node(Node* node,
-							std::set<int> &data_indices,
-							std::vector<FeatureLocation> &sampled_feature_locations, 
-							cv::Mat_<int> &pixel_differences, 
-							std::vector<cv::Mat1d> &regression_targets);
+			void fill_node(Node* node,
+						   const FeatureLocation &parent_location,
+						   std::set<int> &data_indices,
+						   std::vector<cv::Mat1d> &regression_targets);
+			void set_complete(bool complete);
+			void set_split_sampling(int num_features_per_node, int max_split_samples);
+			int get_num_features_per_node();
+			int get_max_split_samples();
+			void build_index();
+			bool is_complete();
+			int get_max_depth();
 			int get_num_leaves();
 			int enumerate_nodes(Node* node);
-			Node* predict(cv::Mat1d &shape, cv::Mat1b &image);
+			Node* get_root();
+			Node* get_leaf_at(int leaf_identifier);
+			FeatureLocation* get_heap_feature_locations();
+			int* get_heap_pixel_difference_thresholds();
 		};
 	}
-}
\ No newline at end of file
+}
+
+BOOST_CLASS_VERSION(lbf::randomforest::Tree, 2)
\ No newline at end of file
@@ -1,13 +1,23 @@
 #include <chrono>
+#include <sstream>
 #include "sampler.h"
 
 namespace lbf {
 	namespace sampler{
 		int seed = std::chrono::system_clock::now().time_since_epoch().count();
-		std::mt19937 mt(seed);
+		thread_local std::mt19937 mt(seed);
 		void set_seed(int seed){
 			mt = std::mt19937(seed);
 		}
+		std::string get_state(){
+			std::ostringstream stream;
+			stream << mt;
+			return stream.str();
+		}
+		void set_state(const std::string &state){
+			std::istringstream stream(state);
+			stream >> mt;
+		}
 		double bernoulli(double p){
 			std::uniform_real_distribution<double> rand(0, 1);
 			double r = rand(mt);
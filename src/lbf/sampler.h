@@ -1,12 +1,16 @@
 #pragma once
 #include <random>
+#include <string>
 
 namespace lbf {
 	namespace sampler {
-		extern std::mt19937 mt;
+		// each thread draws from its own generator
+		extern thread_local std::mt19937 mt;
 		double bernoulli(double p);
 		double uniform(double min, double max);
 		double uniform_int(int min, int max);
 		void set_seed(int seed);
+		std::string get_state();
+		void set_state(const std::string &state);
 	}
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "python/corpus.h"
 #include "python/dataset.h"
+#include "python/evaluator.h"
+#include "python/fine_tuner.h"
 #include "python/model.h"
 #include "python/trainer.h"
 
@@ -22,14 +24,23 @@ BOOST_PYTHON_MODULE(lbf){
 	.def("add", &Corpus::add);
 
 	boost::python::class_<Model>("model", boost::python::init<int, int, int, int, np::ndarray, boost::python::list>((args("num_stages", "num_trees_per_forest", "tree_depth", "num_landmarks", "mean_shape_ndarray", "feature_radius"))))
-	.def(boost::python::init<std::string>())
+	.def(boost::python::init<std::string, boost::python::optional<bool>>((arg("filename"), arg("inference_only")=false)))
 	.def("estimate_shape", &Model::python_estimate_shape)
+	.def("estimate_shape_with_early_exit", &Model::python_estimate_shape_with_early_exit, (arg("image"), arg("tolerance")=0.0, arg("budget")=0.0))
 	.def("estimate_shape_by_translation", &Model::python_estimate_shape_by_translation)
 	.def("estimate_shape_using_initial_shape", &Model::python_estimate_shape_using_initial_shape)
+	.def("estimate_shapes_in_frame", &Model::python_estimate_shapes_in_frame)
 	.def("get_mean_shape", &Model::python_get_mean_shape)
 	.def("compute_error", &Model::python_compute_error)
 	.def("set_num_stages", &Model::set_num_stages)
+	.def("set_complete_trees", &Model::set_complete_trees)
+	.def("set_split_sampling", &Model::set_split_sampling, (arg("num_features_per_node"), arg("max_split_samples")=0))
+	.def("set_image_pyramid", &Model::set_image_pyramid)
+	.def("set_box_features", &Model::set_box_features)
+	.def("set_bilinear_features", &Model::set_bilinear_features)
+	.def("prune", &Model::python_prune, (arg("validation_corpus"), arg("tolerance")))
 	.def("save", &Model::python_save)
+	.def("save_inference_model", &Model::python_save_inference_model)
 	.def("load", &Model::python_load);
 
 	boost::python::class_<Trainer>("trainer", boost::python::init<Corpus*, Corpus*, Model*, int, int>((args("training_corpus", "validation_corpus", "model", "augmentation_size", "num_features_to_sample"))))
@@ -37,8 +48,29 @@ BOOST_PYTHON_MODULE(lbf){
 	.def("get_target_shape", &Trainer::python_get_target_shape, ((args("data_index"), arg("transform")=true)))
 	.def("get_validation_estimated_shape", &Trainer::python_get_validation_estimated_shape, ((args("data_index"), arg("transform")=true)))
 	.def("estimate_shape_only_using_local_binary_features", &Trainer::python_estimate_shape_only_using_local_binary_features, ((args("stage", "data_index"), arg("transform")=true)))
-	.def("evaluate_stage", &Trainer::evaluate_stage)
+	.def("evaluate_stage", &Trainer::python_evaluate_stage)
 	.def("train", &Trainer::train)
-	.def("train_stage", &Trainer::train_stage)
+	.def("train_stage", &Trainer::python_train_stage)
+	.def("set_journal", &Trainer::set_journal)
+	.def("set_cluster", &Trainer::set_cluster)
+	.def("join_cluster", &Trainer::join_cluster)
+	.def("set_cluster_timeout", &Trainer::set_cluster_timeout)
+	.def("set_warm_start_model", &Trainer::set_warm_start_model, boost::python::with_custodian_and_ward<1, 2>())
 	.def("train_local_feature_mapping_functions", &Trainer::train_local_feature_mapping_functions);
+
+	// the fine tuner keeps the model alive
+	boost::python::class_<FineTuner>("fine_tuner", boost::python::init<Model*, double, double>((arg("model"), arg("learning_rate")=0.5, arg("regularization")=0.0))
+																	  [boost::python::with_custodian_and_ward_postcall<1, 2>()])
+	.def("update", &FineTuner::python_update);
+
+	// the evaluator keeps the model and the corpus alive
+	boost::python::class_<Evaluator>("evaluator", boost::python::init<Model*, Corpus*, double, int>((args("model", "corpus"), arg("threshold")=0.08, arg("num_ced_bins")=81))
+																	  [boost::python::with_custodian_and_ward_postcall<1, 2, boost::python::with_custodian_and_ward_postcall<1, 3>>()])
+	.def("evaluate", &Evaluator::python_evaluate)
+	.def("get_image_errors", &Evaluator::python_get_image_errors, (arg("normalization")="inter_ocular"))
+	.def("get_stage_errors", &Evaluator::python_get_stage_errors, (arg("normalization")="inter_ocular"))
+	.def("get_landmark_errors", &Evaluator::python_get_landmark_errors, (arg("normalization")="inter_ocular"))
+	.def("get_ced", &Evaluator::python_get_ced, (arg("normalization")="inter_ocular"))
+	.def("get_auc", &Evaluator::python_get_auc, (arg("normalization")="inter_ocular"))
+	.def("get_failure_rate", &Evaluator::python_get_failure_rate, (arg("normalization")="inter_ocular"));
 }
\ No newline at end of file
@@ -0,0 +1,62 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <sstream>
+#include <vector>
+#include "cluster.h"
+
+namespace lbf {
+	namespace python {
+		Cluster::Cluster(std::string directory){
+			_directory = directory;
+		}
+		bool Cluster::is_writable(){
+			struct stat status;
+			if(stat(_directory.c_str(), &status) != 0 || S_ISDIR(status.st_mode) == false){
+				return false;
+			}
+			return access(_directory.c_str(), W_OK | X_OK) == 0;
+		}
+		std::string Cluster::_get_filename(int type, int stage, int landmark_index){
+			std::ostringstream stream;
+			stream << _directory << "/" << ((type == FOREST_RECORD) ? "forest" : "regressors") << "_" << stage << "_" << landmark_index;
+			return stream.str();
+		}
+		bool Cluster::write_state(const std::string &payload){
+			Journal journal(_directory + "/state");
+			return journal.reset(std::vector<JournalRecord>(1, JournalRecord(STATE_RECORD, -1, -1, payload)));
+		}
+		bool Cluster::read_state(std::string &payload){
+			Journal journal(_directory + "/state");
+			std::vector<JournalRecord> records = journal.read();
+			if(records.size() != 1 || records[0].type != STATE_RECORD){
+				return false;
+			}
+			payload = records[0].payload;
+			return true;
+		}
+		int Cluster::claim(int type, int stage, int landmark_index){
+			std::string filename = _get_filename(type, stage, landmark_index) + ".claim";
+			int descriptor = open(filename.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+			if(descriptor < 0){
+				return (errno == EEXIST) ? CLAIMED_BY_OTHER : CLAIM_FAILED;
+			}
+			close(descriptor);
+			return CLAIMED;
+		}
+		bool Cluster::publish(const JournalRecord &record){
+			Journal journal(_get_filename(record.type, record.stage, record.landmark_index));
+			return journal.reset(std::vector<JournalRecord>(1, record));
+		}
+		bool Cluster::read_result(int type, int stage, int landmark_index, JournalRecord &record){
+			Journal journal(_get_filename(type, stage, landmark_index));
+			std::vector<JournalRecord> records = journal.read();
+			if(records.size() != 1){
+				return false;
+			}
+			record = records[0];
+			return record.type == type && record.stage == stage && record.landmark_index == landmark_index;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include "journal.h"
+
+namespace lbf {
+	namespace python {
+		// directory shared by the processes that train one model, on one machine or on several over a network file system.
+		// the coordinator publishes the trainer state there. a job, the forest or the regressors of a landmark of a stage,
+		// is taken by the process that creates its claim file first and its result is published as a journal of one record.
+		enum { CLAIMED = 0, CLAIMED_BY_OTHER = 1, CLAIM_FAILED = 2 };	// result of a claim
+		class Cluster {
+		private:
+			std::string _get_filename(int type, int stage, int landmark_index);
+		public:
+			std::string _directory;
+			Cluster(std::string directory);
+			// false if the directory does not exist or can not be written
+			bool is_writable();
+			bool write_state(const std::string &payload);
+			// false if the coordinator has not written the state yet
+			bool read_state(std::string &payload);
+			// CLAIMED_BY_OTHER if another process has the job, CLAIM_FAILED if the claim file can not be created
+			int claim(int type, int stage, int landmark_index);
+			bool publish(const JournalRecord &record);
+			// false if the result is not published yet
+			bool read_result(int type, int stage, int landmark_index, JournalRecord &record);
+		};
+	}
+}
\ No newline at end of file
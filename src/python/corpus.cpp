@@ -108,7 +108,7 @@ namespace lbf {
 			cv::Point2d &shift_inv = _shift_inv[data_index];
 
 			boost::python::tuple size = boost::python::make_tuple(2);
-			np::ndarray shift_inv_ndarray = np::zeros(size, np::dtype::get_builtin<uchar>());
+			np::ndarray shift_inv_ndarray = np::zeros(size, np::dtype::get_builtin<double>());
 			shift_inv_ndarray[0] = shift_inv.x;
 			shift_inv_ndarray[1] = shift_inv.y;
 			return shift_inv_ndarray;
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include "evaluator.h"
+#include "gil.h"
+
+namespace np = boost::python::numpy;
+
+namespace lbf {
+	namespace python {
+		Evaluator::Evaluator(Model* model, Corpus* corpus, double threshold, int num_ced_bins){
+			if(threshold <= 0 || num_ced_bins < 2){
+				PyErr_SetString(PyExc_ValueError, "threshold must be positive and num_ced_bins at least 2");
+				boost::python::throw_error_already_set();
+			}
+			_model = model;
+			_corpus = corpus;
+			_threshold = threshold;
+			_num_ced_bins = num_ced_bins;
+		}
+		void Evaluator::evaluate(){
+			int num_data = _corpus->get_num_images();
+			int num_stages = _model->_num_stages;
+			int num_landmarks = _model->_num_landmarks;
+			assert(num_landmarks == 68);
+
+			_image_errors.resize(NUM_NORMALIZATIONS);
+			_landmark_errors.resize(NUM_NORMALIZATIONS);
+			for(int normalization = 0;normalization < NUM_NORMALIZATIONS;normalization++){
+				_image_errors[normalization] = cv::Mat1d(num_data, num_stages);
+				_landmark_errors[normalization] = cv::Mat1d(num_data, num_landmarks);
+			}
+
+			#pragma omp parallel
+			{
+				infer::Workspace workspace;		// per thread
+				#pragma omp for schedule(dynamic)
+				for(int data_index = 0;data_index < num_data;data_index++){
+					cv::Mat1d &target_shape = _corpus->get_normalized_shape(data_index);
+					cv::Mat1d &rotation_inv = _corpus->get_rotation_inv(data_index);
+					cv::Point2d &shift_inv_point = _corpus->get_shift_inv(data_index);
+					infer::Transform image_transform = _model->build_transform(rotation_inv, shift_inv_point);
+					_model->set_image(workspace, _corpus->get_image(data_index));
+
+					// normalizing distances of the target
+					cv::Point2d right_pupil(0, 0);
+					cv::Point2d left_pupil(0, 0);
+					for(int landmark_index = 36;landmark_index < 42;landmark_index++){
+						right_pupil += cv::Point2d(target_shape(landmark_index, 0), target_shape(landmark_index, 1));
+						left_pupil += cv::Point2d(target_shape(landmark_index + 6, 0), target_shape(landmark_index + 6, 1));
+					}
+					right_pupil /= 6;
+					left_pupil /= 6;
+					double normalizers[NUM_NORMALIZATIONS];
+					normalizers[INTER_OCULAR_NORMALIZATION] = std::hypot(target_shape(36, 0) - target_shape(45, 0), target_shape(36, 1) - target_shape(45, 1));
+					normalizers[PUPIL_NORMALIZATION] = std::hypot(right_pupil.x - left_pupil.x, right_pupil.y - left_pupil.y);
+
+					cv::Mat1d estimated_shape = _model->_mean_shape.clone();
+					std::vector<double> distances(num_landmarks);
+					for(int stage = 0;stage < num_stages;stage++){
+						if(_model->_training_finished_at_stage[stage]){
+							_model->estimate_shape_at_stage(workspace, image_transform, stage, estimated_shape);
+						}
+						double mean_distance = 0;
+						for(int landmark_index = 0;landmark_index < num_landmarks;landmark_index++){
+							double error_x = target_shape(landmark_index, 0) - estimated_shape(landmark_index, 0);
+							double error_y = target_shape(landmark_index, 1) - estimated_shape(landmark_index, 1);
+							distances[landmark_index] = std::sqrt(error_x * error_x + error_y * error_y);
+							mean_distance += distances[landmark_index];
+						}
+						mean_distance /= num_landmarks;
+						for(int normalization = 0;normalization < NUM_NORMALIZATIONS;normalization++){
+							_image_errors[normalization](data_index, stage) = mean_distance / normalizers[normalization];
+						}
+					}
+					for(int normalization = 0;normalization < NUM_NORMALIZATIONS;normalization++){
+						for(int landmark_index = 0;landmark_index < num_landmarks;landmark_index++){
+							_landmark_errors[normalization](data_index, landmark_index) = distances[landmark_index] / normalizers[normalization];
+						}
+					}
+				}
+			}
+		}
+		// mean error of the images after each stage
+		cv::Mat1d Evaluator::compute_stage_errors(int normalization){
+			assert(normalization < _image_errors.size());
+			cv::Mat1d &image_errors = _image_errors[normalization];
+			cv::Mat1d stage_errors(image_errors.cols, 1, 0.0);
+			for(int data_index = 0;data_index < image_errors.rows;data_index++){
+				for(int stage = 0;stage < image_errors.cols;stage++){
+					stage_errors(stage, 0) += image_errors(data_index, stage) / image_errors.rows;
+				}
+			}
+			return stage_errors;
+		}
+		cv::Mat1d Evaluator::compute_landmark_errors(int normalization){
+			assert(normalization < _landmark_errors.size());
+			cv::Mat1d &landmark_errors = _landmark_errors[normalization];
+			cv::Mat1d mean_errors(landmark_errors.cols, 1, 0.0);
+			for(int data_index = 0;data_index < landmark_errors.rows;data_index++){
+				for(int landmark_index = 0;landmark_index < landmark_errors.cols;landmark_index++){
+					mean_errors(landmark_index, 0) += landmark_errors(data_index, landmark_index) / landmark_errors.rows;
+				}
+			}
+			return mean_errors;
+		}
+		// cumulative error distribution of the last stage : (num_ced_bins, 2) rows of (error, fraction of images with a smaller or equal error)
+		cv::Mat1d Evaluator::compute_ced(int normalization){
+			assert(normalization < _image_errors.size());
+			cv::Mat1d &image_errors = _image_errors[normalization];
+			int num_data = image_errors.rows;
+			std::vector<double> errors(num_data);
+			for(int data_index = 0;data_index < num_data;data_index++){
+				errors[data_index] = image_errors(data_index, image_errors.cols - 1);
+			}
+			std::sort(errors.begin(), errors.end());
+			cv::Mat1d ced(_num_ced_bins, 2);
+			for(int bin = 0;bin < _num_ced_bins;bin++){
+				double error = _threshold * bin / (_num_ced_bins - 1);
+				int num_below = std::upper_bound(errors.begin(), errors.end(), error) - errors.begin();
+				ced(bin, 0) = error;
+				ced(bin, 1) = (num_data > 0) ? (double)num_below / num_data : 0;
+			}
+			return ced;
+		}
+		// area under the CED curve up to the threshold divided by the threshold, computed exactly from the errors
+		double Evaluator::compute_auc(int normalization){
+			assert(normalization < _image_errors.size());
+			cv::Mat1d &image_errors = _image_errors[normalization];
+			int num_data = image_errors.rows;
+			if(num_data == 0){
+				return 0;
+			}
+			double area = 0;
+			for(int data_index = 0;data_index < num_data;data_index++){
+				double error = image_errors(data_index, image_errors.cols - 1);
+				area += std::max(0.0, _threshold - error);
+			}
+			return area / num_data / _threshold;
+		}
+		double Evaluator::compute_failure_rate(int normalization){
+			assert(normalization < _image_errors.size());
+			cv::Mat1d &image_errors = _image_errors[normalization];
+			int num_data = image_errors.rows;
+			if(num_data == 0){
+				return 0;
+			}
+			int num_failures = 0;
+			for(int data_index = 0;data_index < num_data;data_index++){
+				if(image_errors(data_index, image_errors.cols - 1) > _threshold){
+					num_failures++;
+				}
+			}
+			return (double)num_failures / num_data;
+		}
+		int Evaluator::_get_normalization(std::string normalization){
+			if(normalization == "inter_ocular"){
+				return INTER_OCULAR_NORMALIZATION;
+			}
+			if(normalization == "pupil"){
+				return PUPIL_NORMALIZATION;
+			}
+			PyErr_SetString(PyExc_ValueError, "normalization must be inter_ocular or pupil");
+			boost::python::throw_error_already_set();
+			return -1;
+		}
+		void Evaluator::_check_evaluated(){
+			if(_image_errors.empty()){
+				PyErr_SetString(PyExc_RuntimeError, "call evaluate before reading the errors");
+				boost::python::throw_error_already_set();
+			}
+		}
+		void Evaluator::python_evaluate(){
+			if(_model->_num_landmarks != 68){
+				PyErr_SetString(PyExc_ValueError, "the evaluator needs a model of 68 landmarks");
+				boost::python::throw_error_already_set();
+			}
+			ScopedGILRelease release;
+			evaluate();
+		}
+		np::ndarray Evaluator::python_get_image_errors(std::string normalization){
+			_check_evaluated();
+			int index = _get_normalization(normalization);
+			assert(index < _image_errors.size());
+			return utils::cv_matrix_to_ndarray_matrix(_image_errors[index]);
+		}
+		np::ndarray Evaluator::python_get_stage_errors(std::string normalization){
+			_check_evaluated();
+			cv::Mat1d errors = compute_stage_errors(_get_normalization(normalization));
+			return utils::cv_matrix_to_ndarray_matrix(errors).reshape(boost::python::make_tuple(errors.rows));
+		}
+		np::ndarray Evaluator::python_get_landmark_errors(std::string normalization){
+			_check_evaluated();
+			cv::Mat1d errors = compute_landmark_errors(_get_normalization(normalization));
+			return utils::cv_matrix_to_ndarray_matrix(errors).reshape(boost::python::make_tuple(errors.rows));
+		}
+		np::ndarray Evaluator::python_get_ced(std::string normalization){
+			_check_evaluated();
+			cv::Mat1d ced = compute_ced(_get_normalization(normalization));
+			return utils::cv_matrix_to_ndarray_matrix(ced);
+		}
+		double Evaluator::python_get_auc(std::string normalization){
+			_check_evaluated();
+			return compute_auc(_get_normalization(normalization));
+		}
+		double Evaluator::python_get_failure_rate(std::string normalization){
+			_check_evaluated();
+			return compute_failure_rate(_get_normalization(normalization));
+		}
+	}
+}
\ No newline at end of file
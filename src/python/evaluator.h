@@ -0,0 +1,42 @@
+#pragma once
+#include <boost/python/numpy.hpp>
+#include <string>
+#include <vector>
+#include "corpus.h"
+#include "model.h"
+
+namespace lbf {
+	namespace python {
+		enum { INTER_OCULAR_NORMALIZATION = 0, PUPIL_NORMALIZATION = 1, NUM_NORMALIZATIONS = 2 };
+		// accuracy of a model on a corpus, computed in one parallel pass over the images.
+		// errors are distances in the normalized shape divided by the inter-ocular distance (outer eye corners 36 and 45)
+		// or by the pupil distance (centers of the eye contours 36-41 and 42-47) of the target, so 68 landmarks are required.
+		// stages that are not trained leave the shape unchanged.
+		class Evaluator {
+		private:
+			int _get_normalization(std::string normalization);
+			void _check_evaluated();
+		public:
+			Model* _model;
+			Corpus* _corpus;
+			double _threshold;		// failure threshold, also the upper end of the CED curve and of the AUC
+			int _num_ced_bins;
+			std::vector<cv::Mat1d> _image_errors;		// (num_images, num_stages) per normalization
+			std::vector<cv::Mat1d> _landmark_errors;	// (num_images, num_landmarks) at the last stage per normalization
+			Evaluator(Model* model, Corpus* corpus, double threshold, int num_ced_bins);
+			void evaluate();
+			cv::Mat1d compute_stage_errors(int normalization);
+			cv::Mat1d compute_landmark_errors(int normalization);
+			cv::Mat1d compute_ced(int normalization);
+			double compute_auc(int normalization);
+			double compute_failure_rate(int normalization);
+			void python_evaluate();
+			boost::python::numpy::ndarray python_get_image_errors(std::string normalization);
+			boost::python::numpy::ndarray python_get_stage_errors(std::string normalization);
+			boost::python::numpy::ndarray python_get_landmark_errors(std::string normalization);
+			boost::python::numpy::ndarray python_get_ced(std::string normalization);
+			double python_get_auc(std::string normalization);
+			double python_get_failure_rate(std::string normalization);
+		};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include <boost/python.hpp>
+#include <algorithm>
+#include "fine_tuner.h"
+#include "gil.h"
+
+namespace liblinear = lbf::liblinear;
+
+namespace lbf {
+	namespace python {
+		FineTuner::FineTuner(Model* model, double learning_rate, double regularization){
+			if(model->_inference_only){
+				PyErr_SetString(PyExc_ValueError, "This model was loaded with inference_only and has no liblinear models to fine-tune.");
+				boost::python::throw_error_already_set();
+			}
+			if(learning_rate <= 0 || regularization < 0){
+				PyErr_SetString(PyExc_ValueError, "learning_rate must be positive and regularization not negative.");
+				boost::python::throw_error_already_set();
+			}
+			_model = model;
+			_learning_rate = learning_rate;
+			_regularization = regularization;
+
+			_initial_weights_at_stage.resize(model->_num_stages);
+			for(int stage = 0;stage < model->_num_stages;stage++){
+				if(model->_training_finished_at_stage[stage] == false){
+					continue;
+				}
+				for(int landmark_index = 0;landmark_index < model->_num_landmarks;landmark_index++){
+					liblinear::model* model_x = model->get_linear_model_x_at(stage, landmark_index);
+					liblinear::model* model_y = model->get_linear_model_y_at(stage, landmark_index);
+					_initial_weights_at_stage[stage].emplace_back(model_x->w, model_x->w + model_x->nr_feature);
+					_initial_weights_at_stage[stage].emplace_back(model_y->w, model_y->w + model_y->nr_feature);
+				}
+			}
+		}
+		// one step on the corpus as a mini-batch. returns the mean error before the step.
+		double FineTuner::update(Corpus* corpus){
+			int num_data = corpus->get_num_images();
+			int num_stages = _model->_num_stages;
+			int num_columns = _model->_num_landmarks * 2;
+			if(num_data == 0){
+				return 0;
+			}
+
+			// leaves and residuals of each stage with the current weights
+			std::vector<std::vector<std::vector<int>>> leaf_indices_of_data(num_data, std::vector<std::vector<int>>(num_stages));
+			std::vector<std::vector<std::vector<double>>> residuals_of_data(num_data, std::vector<std::vector<double>>(num_stages));
+			std::vector<double> errors(num_data);
+			#pragma omp parallel
+			{
+				infer::Workspace workspace;		// per thread
+				#pragma omp for schedule(dynamic)
+				for(int data_index = 0;data_index < num_data;data_index++){
+					cv::Mat1d &target_shape = corpus->get_normalized_shape(data_index);
+					cv::Mat1d &rotation_inv = corpus->get_rotation_inv(data_index);
+					cv::Point2d &shift_inv_point = corpus->get_shift_inv(data_index);
+					infer::Transform image_transform = _model->build_transform(rotation_inv, shift_inv_point);
+					_model->set_image(workspace, corpus->get_image(data_index));
+
+					cv::Mat1d estimated_shape = _model->_mean_shape.clone();
+					for(int stage = 0;stage < num_stages;stage++){
+						if(_model->_training_finished_at_stage[stage] == false){
+							continue;
+						}
+						_model->estimate_shape_at_stage(workspace, image_transform, stage, estimated_shape);
+						leaf_indices_of_data[data_index][stage] = workspace._leaf_indices;
+						std::vector<double> &residuals = residuals_of_data[data_index][stage];
+						residuals.resize(num_columns);
+						for(int landmark_index = 0;landmark_index < _model->_num_landmarks;landmark_index++){
+							residuals[landmark_index * 2 + 0] = target_shape(landmark_index, 0) - estimated_shape(landmark_index, 0);
+							residuals[landmark_index * 2 + 1] = target_shape(landmark_index, 1) - estimated_shape(landmark_index, 1);
+						}
+					}
+					errors[data_index] = _model->compute_mean_error(target_shape, estimated_shape, corpus->get_normalized_pupil_distance(data_index));
+				}
+			}
+
+			// every column of the regression table is a liblinear model of its own, so the columns are updated in parallel.
+			// the gradient of a face is divided by its number of leaves, which makes the step independent of the number of trees.
+			for(int stage = 0;stage < num_stages;stage++){
+				if(_model->_training_finished_at_stage[stage] == false){
+					continue;
+				}
+				#pragma omp parallel for
+				for(int column = 0;column < num_columns;column++){
+					int landmark_index = column / 2;
+					liblinear::model* linear_model = (column % 2 == 0) ? _model->get_linear_model_x_at(stage, landmark_index) : _model->get_linear_model_y_at(stage, landmark_index);
+					double* w = linear_model->w;
+					if(_regularization > 0){
+						const std::vector<double> &initial_weights = _initial_weights_at_stage[stage][column];
+						double decay = std::min(_learning_rate * _regularization, 1.0);
+						for(int leaf_index = 0;leaf_index < linear_model->nr_feature;leaf_index++){
+							w[leaf_index] -= decay * (w[leaf_index] - initial_weights[leaf_index]);
+						}
+					}
+					for(int data_index = 0;data_index < num_data;data_index++){
+						const std::vector<int> &leaf_indices = leaf_indices_of_data[data_index][stage];
+						if(leaf_indices.empty()){
+							continue;
+						}
+						double step = _learning_rate * residuals_of_data[data_index][stage][column] / leaf_indices.size() / num_data;
+						for(int leaf_index: leaf_indices){
+							if(leaf_index < linear_model->nr_feature){
+								w[leaf_index] += step;
+							}
+						}
+					}
+				}
+				_model->update_engine_weights(stage);
+			}
+
+			double mean_error = 0;
+			for(int data_index = 0;data_index < num_data;data_index++){
+				mean_error += errors[data_index] / num_data;
+			}
+			return mean_error;
+		}
+		double FineTuner::python_update(Corpus* corpus){
+			ScopedGILRelease release;
+			return update(corpus);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+#include <vector>
+#include "corpus.h"
+#include "model.h"
+
+namespace lbf {
+	namespace python {
+		// adapts the global regression of a trained model to new faces while the forests stay fixed.
+		// an update runs a mini-batch through the cascade from the mean shape, like estimation does,
+		// and takes one gradient step on the squared error after each stage.
+		// the memory depends on the size of the mini-batch, not on the number of faces seen.
+		class FineTuner {
+		public:
+			Model* _model;
+			double _learning_rate;		// 1 : a stage fits a mini-batch of one face exactly
+			double _regularization;		// pulls the weights back to the ones of the original model
+			std::vector<std::vector<std::vector<double>>> _initial_weights_at_stage;	// (stage, landmark * 2 + axis, leaf)
+			FineTuner(Model* model, double learning_rate, double regularization);
+			double update(Corpus* corpus);
+			double python_update(Corpus* corpus);
+		};
+	}
+}
\ No newline at end of file
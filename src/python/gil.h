@@ -0,0 +1,21 @@
+#pragma once
+#include <Python.h>
+
+namespace lbf {
+	namespace python {
+		// releases the GIL for the lifetime of the object so that other Python threads run during native compute.
+		// no Python object, ndarray included, may be touched in its scope.
+		// the only exception is reading the data of an input ndarray in place, which the caller keeps alive.
+		class ScopedGILRelease {
+		private:
+			PyThreadState* _thread_state;
+		public:
+			ScopedGILRelease(){
+				_thread_state = PyEval_SaveThread();
+			}
+			~ScopedGILRelease(){
+				PyEval_RestoreThread(_thread_state);
+			}
+		};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include <unistd.h>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "journal.h"
+
+namespace lbf {
+	namespace python {
+		namespace {
+			void write_record(std::ostream &stream, const JournalRecord &record){
+				uint64_t size = record.payload.size();
+				stream.write(reinterpret_cast<const char*>(&record.type), sizeof(int));
+				stream.write(reinterpret_cast<const char*>(&record.stage), sizeof(int));
+				stream.write(reinterpret_cast<const char*>(&record.landmark_index), sizeof(int));
+				stream.write(reinterpret_cast<const char*>(&size), sizeof(uint64_t));
+				stream.write(record.payload.data(), size);
+			}
+			bool write_and_sync(FILE* file, const std::string &data){
+				if(file == NULL){
+					return false;
+				}
+				bool success = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+				success = std::fflush(file) == 0 && success;
+				success = fsync(fileno(file)) == 0 && success;
+				success = std::fclose(file) == 0 && success;
+				return success;
+			}
+		}
+		JournalRecord::JournalRecord(){
+			type = STATE_RECORD;
+			stage = -1;
+			landmark_index = -1;
+		}
+		JournalRecord::JournalRecord(int type, int stage, int landmark_index, const std::string &payload){
+			this->type = type;
+			this->stage = stage;
+			this->landmark_index = landmark_index;
+			this->payload = payload;
+		}
+		Journal::Journal(std::string filename){
+			_filename = filename;
+		}
+		bool Journal::exists(){
+			std::ifstream ifs(_filename);
+			return ifs.good();
+		}
+		bool Journal::reset(const std::vector<JournalRecord> &records){
+			std::ostringstream stream;
+			for(const JournalRecord &record: records){
+				write_record(stream, record);
+			}
+			return write_file_atomically(_filename, stream.str());
+		}
+		bool Journal::append(const JournalRecord &record){
+			std::ostringstream stream;
+			write_record(stream, record);
+			return write_and_sync(std::fopen(_filename.c_str(), "ab"), stream.str());
+		}
+		std::vector<JournalRecord> Journal::read(){
+			std::vector<JournalRecord> records;
+			std::ifstream ifs(_filename, std::ios::binary | std::ios::ate);
+			std::streamoff file_size = ifs.tellg();
+			ifs.seekg(0);
+			while(ifs.peek() != EOF){
+				JournalRecord record;
+				uint64_t size = 0;
+				ifs.read(reinterpret_cast<char*>(&record.type), sizeof(int));
+				ifs.read(reinterpret_cast<char*>(&record.stage), sizeof(int));
+				ifs.read(reinterpret_cast<char*>(&record.landmark_index), sizeof(int));
+				ifs.read(reinterpret_cast<char*>(&size), sizeof(uint64_t));
+				if(ifs.good() == false || size > (uint64_t)(file_size - ifs.tellg())){
+					std::cout << _filename << ": dropped a torn record." << std::endl;
+					break;
+				}
+				record.payload.resize(size);
+				ifs.read(&record.payload[0], size);
+				records.push_back(record);
+			}
+			return records;
+		}
+		bool write_file_atomically(const std::string &filename, const std::string &data){
+			std::string temporary_filename = filename + ".tmp";
+			if(write_and_sync(std::fopen(temporary_filename.c_str(), "wb"), data) == false){
+				std::remove(temporary_filename.c_str());
+				return false;
+			}
+			return std::rename(temporary_filename.c_str(), filename.c_str()) == 0;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <vector>
+
+namespace lbf {
+	namespace python {
+		enum { STATE_RECORD = 0, FOREST_RECORD = 1, REGRESSORS_RECORD = 2 };
+		struct JournalRecord {
+			int type;
+			int stage;
+			int landmark_index;
+			std::string payload;		// boost binary archive
+			JournalRecord();
+			JournalRecord(int type, int stage, int landmark_index, const std::string &payload);
+		};
+		// append-only file of length-prefixed records.
+		// a record torn by a crash is detected when the journal is read and everything from it on is dropped.
+		class Journal {
+		public:
+			std::string _filename;
+			Journal(std::string filename);
+			bool exists();
+			// atomically replaces the journal with these records
+			bool reset(const std::vector<JournalRecord> &records);
+			bool append(const JournalRecord &record);
+			std::vector<JournalRecord> read();
+		};
+		// writes to a temporary file next to the target and renames it over the target,
+		// so the target always holds either the old or the new data in full
+		bool write_file_atomically(const std::string &filename, const std::string &data);
+	}
+}
\ No newline at end of file
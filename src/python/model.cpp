@@ -1,8 +1,15 @@
 #include <boost/serialization/split_member.hpp>
 #include <boost/serialization/vector.hpp>
+#include <algorithm>
 #include <fstream>
 #include <cassert>
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include "gil.h"
+#include "journal.h"
 #include "model.h"
 
 using namespace lbf::randomforest;
@@ -45,6 +52,10 @@ namespace lbf {
 			_num_landmarks = num_landmarks;
 			_tree_depth = tree_depth;
 			_local_radius_at_stage = feature_radius;
+			_pyramid_level_at_stage.assign(num_stages, 0);
+			_box_radius_at_stage.assign(num_stages, 0);
+			_bilinear_at_stage.assign(num_stages, false);
+			_inference_only = false;
 
 			// convert mean shape to cv::Mat
 			auto size = mean_shape_ndarray.get_shape();
@@ -87,19 +98,530 @@ namespace lbf {
 			for(int stage = 0;stage < num_stages;stage++){
 				_training_finished_at_stage[stage] = false;
 			}
+
+			_engine.init(num_stages, num_landmarks, _mean_shape.ptr<double>(0));
 		}
-		Model::Model(std::string filename){
+		Model::Model(std::string filename, bool inference_only){
+			if(inference_only){
+				_load_inference_model(filename);
+				return;
+			}
 			if(python_load(filename) == false){
-				std::cout << filename << " not found." << std::endl;
-				exit(0);
+				throw std::runtime_error(filename + " not found.");
+			}
+		}
+		void Model::_load_inference_model(std::string filename){
+			if(_engine.map(filename) == false){
+				throw std::runtime_error(filename + " is not a model written by save_inference_model.");
+			}
+			_inference_only = true;
+			_num_stages = _engine._num_stages;
+			_num_landmarks = _engine._num_landmarks;
+			_num_trees_per_forest = 0;
+			_tree_depth = 0;
+			_mean_shape = cv::Mat1d(_num_landmarks, 2);
+			std::copy(_engine._mean_shape.begin(), _engine._mean_shape.end(), _mean_shape.ptr<double>(0));
+			int num_stages = _engine._stages.size();
+			_local_radius_at_stage.assign(num_stages, 0);
+			_box_radius_at_stage.assign(num_stages, 0);
+			_bilinear_at_stage.assign(num_stages, false);
+			_pyramid_level_at_stage.resize(num_stages);
+			_training_finished_at_stage.resize(num_stages);
+			for(int stage = 0;stage < num_stages;stage++){
+				_pyramid_level_at_stage[stage] = _engine._stages[stage].pyramid_level;
+				_training_finished_at_stage[stage] = _engine._stages[stage].trained;
+			}
+		}
+		// the training options only apply to a model with forests, which one of save_inference_model does not have
+		void Model::_check_trainable(){
+			if(_inference_only){
+				PyErr_SetString(PyExc_ValueError, "an inference-only model has no forests to configure");
+				boost::python::throw_error_already_set();
 			}
 		}
 		void Model::set_num_stages(int num_stages){
 			_num_stages = num_stages;
+			_engine.set_num_stages(num_stages);
+		}
+		// grow complete trees of depth _tree_depth in the stages that are not trained yet
+		void Model::set_complete_trees(bool complete){
+			_check_trainable();
+			for(int stage = 0;stage < _num_stages;stage++){
+				if(_training_finished_at_stage[stage]){
+					continue;
+				}
+				for(auto forest: _forest_at_stage[stage]){
+					forest->set_complete(complete);
+				}
+			}
+		}
+		// split the nodes of the stages that are not trained yet on a random subset of the features,
+		// and compute the split statistics of nodes with more data on a random subset of it. 0 uses all.
+		void Model::set_split_sampling(int num_features_per_node, int max_split_samples){
+			_check_trainable();
+			for(int stage = 0;stage < _num_stages;stage++){
+				if(_training_finished_at_stage[stage]){
+					continue;
+				}
+				for(auto forest: _forest_at_stage[stage]){
+					forest->set_split_sampling(num_features_per_node, max_split_samples);
+				}
+			}
+		}
+		// read the pixel features of the stages that are not trained yet from a smoothed pyramid.
+		// the finest radius is sampled at full resolution and each doubling of the radius moves one level down.
+		void Model::set_image_pyramid(int num_levels){
+			_check_trainable();
+			if(num_levels <= 0){
+				PyErr_SetString(PyExc_ValueError, "num_levels must be positive");
+				boost::python::throw_error_already_set();
+			}
+			double min_radius = *std::min_element(_local_radius_at_stage.begin(), _local_radius_at_stage.begin() + _num_stages);
+			assert(min_radius > 0);
+			for(int stage = 0;stage < _num_stages;stage++){
+				if(_training_finished_at_stage[stage]){
+					continue;
+				}
+				int level = std::floor(std::log2(_local_radius_at_stage[stage] / min_radius));
+				_pyramid_level_at_stage[stage] = std::max(0, std::min(level, num_levels - 1));
+			}
+		}
+		int Model::get_pyramid_level_at_stage(int stage){
+			assert(stage < _pyramid_level_at_stage.size());
+			return _pyramid_level_at_stage[stage];
+		}
+		int Model::get_num_pyramid_levels(){
+			int num_levels = 1;
+			for(int stage = 0;stage < _num_stages;stage++){
+				num_levels = std::max(num_levels, _pyramid_level_at_stage[stage] + 1);
+			}
+			return num_levels;
+		}
+		// replace the single pixels of a stage by the mean of boxes with the given half size.
+		// box_radius is in the same [-1, 1] coordinates as feature_radius and 0 switches back to pixels.
+		void Model::set_box_features(int stage, double box_radius){
+			_check_trainable();
+			if(stage < 0 || stage >= _num_stages || box_radius < 0){
+				PyErr_SetString(PyExc_ValueError, "box_radius must not be negative and stage one of the model");
+				boost::python::throw_error_already_set();
+			}
+			if(_training_finished_at_stage[stage]){
+				return;
+			}
+			_box_radius_at_stage[stage] = box_radius;
+		}
+		bool Model::use_box_features(){
+			for(int stage = 0;stage < _num_stages;stage++){
+				if(_box_radius_at_stage[stage] > 0){
+					return true;
+				}
+			}
+			return false;
+		}
+		// read the pixel features of a stage between pixels : the luminosity at a feature point is interpolated
+		// from the 4 nearest pixels instead of taken from the pixel it falls in. stages of box features ignore it.
+		void Model::set_bilinear_features(int stage, bool bilinear){
+			_check_trainable();
+			if(stage < 0 || stage >= _num_stages){
+				PyErr_SetString(PyExc_ValueError, "stage must be one of the model");
+				boost::python::throw_error_already_set();
+			}
+			if(_training_finished_at_stage[stage]){
+				return;
+			}
+			_bilinear_at_stage[stage] = bilinear;
+		}
+		FaceImage Model::build_face_image(cv::Mat1b &image){
+			return FaceImage(image, get_num_pyramid_levels(), use_box_features());
+		}
+		void Model::set_image(infer::Workspace &workspace, cv::Mat1b &image){
+			_engine.set_image(workspace, image.data, image.cols, image.rows, image.step);
+		}
+		infer::Transform Model::build_transform(cv::Mat1d &rotation, cv::Point2d shift){
+			assert(rotation.rows == 2 && rotation.cols == 2);
+			infer::Transform transform;
+			transform.rotation[0] = rotation(0, 0);
+			transform.rotation[1] = rotation(0, 1);
+			transform.rotation[2] = rotation(1, 0);
+			transform.rotation[3] = rotation(1, 1);
+			transform.shift[0] = shift.x;
+			transform.shift[1] = shift.y;
+			return transform;
 		}
 		void Model::finish_training_at_stage(int stage){
 			assert(stage < _num_stages);
 			_training_finished_at_stage[stage] = true;
+			_build_engine_stage(stage);
+		}
+		// copy a finished stage into the inference engine.
+		// trees are flattened breadth first so that siblings are adjacent, which stores complete trees in heap order.
+		// liblinear keeps one weight vector per (landmark, axis) indexed by leaf, while every reached leaf adds its weight
+		// to all outputs, so the weights are stored leaf-major and a leaf contributes one contiguous row.
+		void Model::_build_engine_stage(int stage){
+			assert(stage < _num_stages);
+			infer::Stage &engine_stage = _engine._stages[stage];
+			engine_stage.pyramid_level = _pyramid_level_at_stage[stage];
+			engine_stage.tree_offsets.clear();
+			engine_stage.trees.clear();
+			engine_stage.nodes.clear();
+
+			int num_total_leaves = 0;
+			for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
+				engine_stage.tree_offsets.push_back(engine_stage.trees.size());
+				Forest* forest = get_forest(stage, landmark_index);
+				for(int tree_index = 0;tree_index < forest->get_num_trees();tree_index++){
+					Tree* tree = forest->get_tree_at(tree_index);
+					infer::Tree engine_tree;
+					engine_tree.first_node = engine_stage.nodes.size();
+					engine_tree.first_leaf = num_total_leaves;
+					engine_tree.depth = tree->is_complete() ? tree->get_max_depth() : 0;
+
+					std::vector<Node*> queue(1, tree->get_root());
+					for(int node_index = 0;node_index < queue.size();node_index++){
+						Node* node = queue[node_index];
+						infer::Node engine_node = infer::Node();
+						if(node->_is_leaf){
+							engine_node.child = ~node->identifier();
+						}else{
+							FeatureLocation &location = node->_feature_location;
+							engine_node.a_x = location.a.x;
+							engine_node.a_y = location.a.y;
+							engine_node.b_x = location.b.x;
+							engine_node.b_y = location.b.y;
+							engine_node.box_radius = location.box_radius;
+							engine_node.type = location.type;
+							engine_node.threshold = node->_pixel_difference_threshold;
+							engine_node.child = queue.size();
+							queue.push_back(node->_left);
+							queue.push_back(node->_right);
+						}
+						engine_stage.nodes.push_back(engine_node);
+					}
+					engine_stage.trees.push_back(engine_tree);
+					num_total_leaves += tree->get_num_leaves();
+				}
+			}
+			engine_stage.tree_offsets.push_back(engine_stage.trees.size());
+			engine_stage.num_leaves = num_total_leaves;
+			update_engine_weights(stage);
+			_engine.finish_stage(stage);
+		}
+		// copies the liblinear weights of the stage into the regression table of the engine
+		void Model::update_engine_weights(int stage){
+			assert(stage < _num_stages);
+			infer::Stage &engine_stage = _engine._stages[stage];
+			int num_total_leaves = engine_stage.num_leaves;
+			int num_columns = _num_landmarks * 2;
+			std::vector<float> &weights = engine_stage.weights;
+			weights.assign(num_total_leaves * num_columns, 0);
+			for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
+				lbf::liblinear::model* model_x = get_linear_model_x_at(stage, landmark_index);
+				lbf::liblinear::model* model_y = get_linear_model_y_at(stage, landmark_index);
+				assert(model_x != NULL);
+				assert(model_y != NULL);
+				for(int leaf_index = 0;leaf_index < num_total_leaves;leaf_index++){
+					// feature index = leaf_index + 1
+					float* row = &weights[leaf_index * num_columns];
+					row[landmark_index * 2 + 0] = (leaf_index < model_x->nr_feature) ? model_x->w[leaf_index] : 0;
+					row[landmark_index * 2 + 1] = (leaf_index < model_y->nr_feature) ? model_y->w[leaf_index] : 0;
+				}
+			}
+		}
+		// zeroes the rows of a range of leaves in the regression table of the engine, or copies them back from the regressors
+		void Model::_set_leaf_rows(int stage, int first_leaf, int num_leaves, bool zero){
+			infer::Stage &engine_stage = _engine._stages[stage];
+			int num_columns = _num_landmarks * 2;
+			for(int leaf_index = first_leaf;leaf_index < first_leaf + num_leaves;leaf_index++){
+				float* row = &engine_stage.weights[leaf_index * num_columns];
+				for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
+					lbf::liblinear::model* model_x = get_linear_model_x_at(stage, landmark_index);
+					lbf::liblinear::model* model_y = get_linear_model_y_at(stage, landmark_index);
+					row[landmark_index * 2 + 0] = (zero || leaf_index >= model_x->nr_feature) ? 0 : model_x->w[leaf_index];
+					row[landmark_index * 2 + 1] = (zero || leaf_index >= model_y->nr_feature) ? 0 : model_y->w[leaf_index];
+				}
+			}
+		}
+		// mean error of the corpus after the finished stages from first_stage on, starting from shapes
+		double Model::_compute_validation_error(Corpus* corpus, int first_stage, const std::vector<cv::Mat1d> &shapes){
+			int num_data = corpus->get_num_images();
+			std::vector<double> errors(num_data);
+			#pragma omp parallel
+			{
+				infer::Workspace workspace;		// per thread
+				#pragma omp for schedule(dynamic)
+				for(int data_index = 0;data_index < num_data;data_index++){
+					infer::Transform transform = build_transform(corpus->get_rotation_inv(data_index), corpus->get_shift_inv(data_index));
+					set_image(workspace, corpus->get_image(data_index));
+					cv::Mat1d estimated_shape = shapes[data_index].clone();
+					for(int stage = first_stage;stage < _num_stages;stage++){
+						if(_training_finished_at_stage[stage]){
+							estimate_shape_at_stage(workspace, transform, stage, estimated_shape);
+						}
+					}
+					errors[data_index] = compute_mean_error(corpus->get_normalized_shape(data_index), estimated_shape, corpus->get_normalized_pupil_distance(data_index));
+				}
+			}
+			double mean_error = 0;
+			for(double error: errors){
+				mean_error += error / num_data;
+			}
+			return mean_error;
+		}
+		// moves shapes through one finished stage
+		void Model::_apply_stage(Corpus* corpus, int stage, std::vector<cv::Mat1d> &shapes){
+			int num_data = corpus->get_num_images();
+			#pragma omp parallel
+			{
+				infer::Workspace workspace;		// per thread
+				#pragma omp for schedule(dynamic)
+				for(int data_index = 0;data_index < num_data;data_index++){
+					infer::Transform transform = build_transform(corpus->get_rotation_inv(data_index), corpus->get_shift_inv(data_index));
+					set_image(workspace, corpus->get_image(data_index));
+					estimate_shape_at_stage(workspace, transform, stage, shapes[data_index]);
+				}
+			}
+		}
+		// microseconds of estimate_shape per face on one thread, the best of a few passes over the corpus.
+		// the images are set outside of the clock since pruning does not change that part.
+		double Model::_measure_time_per_face(Corpus* corpus){
+			int num_data = corpus->get_num_images();
+			infer::Workspace workspace;
+			cv::Mat1d estimated_shape(_num_landmarks, 2);
+			double best_time = 0;
+			for(int pass = 0;pass < 5;pass++){
+				double time = 0;
+				for(int data_index = 0;data_index < num_data;data_index++){
+					infer::Transform transform = build_transform(corpus->get_rotation_inv(data_index), corpus->get_shift_inv(data_index));
+					set_image(workspace, corpus->get_image(data_index));
+					auto start = std::chrono::steady_clock::now();
+					_engine.estimate_shape(transform, estimated_shape.ptr<double>(0), workspace);
+					time += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+				}
+				if(pass == 0 || time < best_time){
+					best_time = time;
+				}
+			}
+			return best_time / num_data;
+		}
+		// removes trees, and whole forests after the first stage, while the mean validation error of the corpus stays
+		// within tolerance of the one of the unpruned model, in the % of compute_mean_error.
+		// a removal is tried by zeroing the rows of its leaves in the regression tables of the engine, which gives the same shapes,
+		// and every stage is decided on the shapes that the pruned stages before it reach.
+		// the forests of a stage are tried one by one, then the remaining trees in batches from the smallest move up,
+		// where a tree moves the shape by the largest norm of the rows of its leaves. a failed batch is halved
+		// and the stage ends when a single tree fails. the removed trees are then deleted and the leaves of the regressors renumbered.
+		PruneReport Model::prune(Corpus* corpus, double tolerance){
+			assert(_inference_only == false);
+			int num_data = corpus->get_num_images();
+			assert(num_data > 0);
+			int num_columns = _num_landmarks * 2;
+			PruneReport report;
+			report.num_removed_trees = 0;
+			std::vector<cv::Mat1d> shapes(num_data);		// shapes before the stage
+			for(int data_index = 0;data_index < num_data;data_index++){
+				shapes[data_index] = _mean_shape.clone();
+			}
+			report.time_before = _measure_time_per_face(corpus);
+			report.error_before = _compute_validation_error(corpus, 0, shapes);
+			double max_error = report.error_before + tolerance;
+
+			std::vector<std::vector<bool>> removed_at_stage(_num_stages);		// per tree of the stage
+			for(int stage = 0;stage < _num_stages;stage++){
+				if(_training_finished_at_stage[stage] == false){
+					continue;
+				}
+				// leaves and move of each tree
+				struct Candidate {
+					int landmark_index;
+					int tree_index;
+					int first_leaf;
+					int num_leaves;
+					double move;
+				};
+				std::vector<Candidate> candidates;
+				std::vector<int> first_candidate_of_landmark(_num_landmarks + 1, 0);
+				const std::vector<float> &weights = _engine._stages[stage].weights;
+				int leaf_offset = 0;
+				for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
+					Forest* forest = get_forest(stage, landmark_index);
+					first_candidate_of_landmark[landmark_index] = candidates.size();
+					for(int tree_index = 0;tree_index < forest->get_num_trees();tree_index++){
+						Candidate candidate;
+						candidate.landmark_index = landmark_index;
+						candidate.tree_index = tree_index;
+						candidate.first_leaf = leaf_offset;
+						candidate.num_leaves = forest->get_tree_at(tree_index)->get_num_leaves();
+						candidate.move = 0;
+						for(int leaf_index = leaf_offset;leaf_index < leaf_offset + candidate.num_leaves;leaf_index++){
+							double move = 0;
+							for(int column = 0;column < num_columns;column++){
+								move += weights[leaf_index * num_columns + column] * weights[leaf_index * num_columns + column];
+							}
+							candidate.move = std::max(candidate.move, std::sqrt(move));
+						}
+						candidates.push_back(candidate);
+						leaf_offset += candidate.num_leaves;
+					}
+				}
+				first_candidate_of_landmark[_num_landmarks] = candidates.size();
+				std::vector<bool> &removed = removed_at_stage[stage];
+				removed.assign(candidates.size(), false);
+				int num_removed_forests = 0;
+				int num_removed_trees = 0;
+
+				// whole forests, from the smallest total move up
+				if(stage > 0){
+					std::vector<double> forest_moves(_num_landmarks, 0);
+					std::vector<int> landmark_order(_num_landmarks);
+					for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
+						for(int index = first_candidate_of_landmark[landmark_index];index < first_candidate_of_landmark[landmark_index + 1];index++){
+							forest_moves[landmark_index] += candidates[index].move;
+						}
+						landmark_order[landmark_index] = landmark_index;
+					}
+					std::stable_sort(landmark_order.begin(), landmark_order.end(), [&](int a, int b){ return forest_moves[a] < forest_moves[b]; });
+					for(int landmark_index: landmark_order){
+						int begin = first_candidate_of_landmark[landmark_index];
+						int end = first_candidate_of_landmark[landmark_index + 1];
+						if(begin == end){
+							continue;
+						}
+						for(int index = begin;index < end;index++){
+							_set_leaf_rows(stage, candidates[index].first_leaf, candidates[index].num_leaves, true);
+						}
+						double error = _compute_validation_error(corpus, stage, shapes);
+						if(error > max_error){
+							for(int index = begin;index < end;index++){
+								_set_leaf_rows(stage, candidates[index].first_leaf, candidates[index].num_leaves, false);
+							}
+							continue;
+						}
+						for(int index = begin;index < end;index++){
+							removed[index] = true;
+						}
+						report.removed.push_back(PrunedTree{stage, landmark_index, -1, error});
+						num_removed_forests++;
+						num_removed_trees += end - begin;
+					}
+				}
+
+				// single trees in growing batches
+				std::vector<int> order;
+				for(int index = 0;index < candidates.size();index++){
+					if(removed[index] == false){
+						order.push_back(index);
+					}
+				}
+				std::stable_sort(order.begin(), order.end(), [&](int a, int b){ return candidates[a].move < candidates[b].move; });
+				int position = 0;
+				int batch_size = 1;
+				while(position < order.size()){
+					int end = std::min(position + batch_size, (int)order.size());
+					for(int k = position;k < end;k++){
+						_set_leaf_rows(stage, candidates[order[k]].first_leaf, candidates[order[k]].num_leaves, true);
+					}
+					double error = _compute_validation_error(corpus, stage, shapes);
+					if(error > max_error){
+						for(int k = position;k < end;k++){
+							_set_leaf_rows(stage, candidates[order[k]].first_leaf, candidates[order[k]].num_leaves, false);
+						}
+						if(batch_size == 1){
+							break;
+						}
+						batch_size /= 2;
+						continue;
+					}
+					for(int k = position;k < end;k++){
+						const Candidate &candidate = candidates[order[k]];
+						removed[order[k]] = true;
+						report.removed.push_back(PrunedTree{stage, candidate.landmark_index, candidate.tree_index, error});
+					}
+					num_removed_trees += end - position;
+					position = end;
+					batch_size *= 2;
+				}
+				report.num_removed_trees += num_removed_trees;
+				std::cout << "stage " << (stage + 1) << ": removed " << num_removed_forests << " forests and " << num_removed_trees << " trees in total" << std::endl;
+
+				_apply_stage(corpus, stage, shapes);
+			}
+
+			// delete the removed trees and renumber the leaves in the regressors
+			for(int stage = 0;stage < _num_stages;stage++){
+				if(_training_finished_at_stage[stage] == false){
+					continue;
+				}
+				std::vector<bool> &removed = removed_at_stage[stage];
+				std::vector<bool> keep_leaf;
+				int tree_offset = 0;
+				for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
+					Forest* forest = get_forest(stage, landmark_index);
+					int num_trees = forest->get_num_trees();
+					for(int tree_index = 0;tree_index < num_trees;tree_index++){
+						int num_leaves = forest->get_tree_at(tree_index)->get_num_leaves();
+						keep_leaf.insert(keep_leaf.end(), num_leaves, removed[tree_offset + tree_index] == false);
+					}
+					for(int tree_index = num_trees - 1;tree_index >= 0;tree_index--){
+						if(removed[tree_offset + tree_index]){
+							forest->remove_tree(tree_index);
+						}
+					}
+					tree_offset += num_trees;
+				}
+				for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
+					lbf::liblinear::model* models[2] = {get_linear_model_x_at(stage, landmark_index), get_linear_model_y_at(stage, landmark_index)};
+					for(lbf::liblinear::model* model: models){
+						assert(model->nr_feature <= keep_leaf.size());
+						int num_kept_leaves = 0;
+						for(int leaf_index = 0;leaf_index < model->nr_feature;leaf_index++){
+							if(keep_leaf[leaf_index]){
+								model->w[num_kept_leaves] = model->w[leaf_index];
+								num_kept_leaves++;
+							}
+						}
+						if(model->bias >= 0){
+							model->w[num_kept_leaves] = model->w[model->nr_feature];
+						}
+						model->nr_feature = num_kept_leaves;
+					}
+				}
+				_build_engine_stage(stage);
+			}
+			for(int data_index = 0;data_index < num_data;data_index++){
+				shapes[data_index] = _mean_shape.clone();
+			}
+			report.error_after = _compute_validation_error(corpus, 0, shapes);
+			report.time_after = _measure_time_per_face(corpus);
+			return report;
+		}
+		// dict of error_before, error_after, time_before, time_after, num_removed_trees
+		// and removed : (stage, landmark_index, tree_index, error) in the order of removal, tree_index -1 for a whole forest
+		boost::python::dict Model::python_prune(Corpus* corpus, double tolerance){
+			if(_inference_only){
+				PyErr_SetString(PyExc_ValueError, "an inference-only model has no forests to prune");
+				boost::python::throw_error_already_set();
+			}
+			if(corpus->get_num_images() == 0 || tolerance < 0){
+				PyErr_SetString(PyExc_ValueError, "prune needs a validation corpus with images and a tolerance that is not negative");
+				boost::python::throw_error_already_set();
+			}
+			PruneReport report;
+			{
+				ScopedGILRelease release;
+				report = prune(corpus, tolerance);
+			}
+			boost::python::list removed;
+			for(const PrunedTree &tree: report.removed){
+				removed.append(boost::python::make_tuple(tree.stage, tree.landmark_index, tree.tree_index, tree.error));
+			}
+			boost::python::dict result;
+			result["error_before"] = report.error_before;
+			result["error_after"] = report.error_after;
+			result["time_before"] = report.time_before;
+			result["time_after"] = report.time_after;
+			result["num_removed_trees"] = report.num_removed_trees;
+			result["removed"] = removed;
+			return result;
 		}
 		Forest* Model::get_forest(int stage, int landmark_index){
 			assert(stage < _num_stages);
@@ -152,40 +674,45 @@ namespace lbf {
 			}
 			save_liblinear_models(ar, _linear_models_x_at_stage);
 			save_liblinear_models(ar, _linear_models_y_at_stage);
+			ar & _pyramid_level_at_stage;
+			ar & _box_radius_at_stage;
+			ar & _bilinear_at_stage;
 		}
 		void Model::save_liblinear_models(boost::archive::binary_oarchive &ar, const std::vector<std::vector<lbf::liblinear::model*>> &linear_models_at_stage) const {
 			for(int stage = 0;stage < _num_stages;stage++){
 				const std::vector<lbf::liblinear::model*> &linear_models = linear_models_at_stage[stage];
 				for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
-					lbf::liblinear::model const* model = linear_models[landmark_index];
-					bool skip_flag = true ? model == NULL : false;
-					ar & skip_flag;
-					if(skip_flag){
-						continue;
-					}
-					const lbf::liblinear::parameter &param = model->param;
-					int nr_feature = model->nr_feature;
+					save_liblinear_model(ar, linear_models[landmark_index]);
+				}
+			}
+		}
+		void Model::save_liblinear_model(boost::archive::binary_oarchive &ar, const lbf::liblinear::model* model) const {
+			bool skip_flag = true ? model == NULL : false;
+			ar & skip_flag;
+			if(skip_flag){
+				return;
+			}
+			const lbf::liblinear::parameter &param = model->param;
+			int nr_feature = model->nr_feature;
 
-					ar & param.solver_type;
-					ar & model->nr_class;
-					ar & model->bias;
+			ar & param.solver_type;
+			ar & model->nr_class;
+			ar & model->bias;
 
-					int w_size = nr_feature;
-					if(model->bias >= 0){
-						w_size = nr_feature + 1;
-					}
-					int nr_w = model->nr_class;
-					if(model->nr_class == 2 && param.solver_type != lbf::liblinear::MCSVM_CS){
-						nr_w = 1;
-					}
-					ar & nr_feature;
-					ar & nr_w;
-					ar & w_size;
-					for(int i = 0;i < w_size;i++){
-						for(int j = 0;j < nr_w;j++){
-							ar & model->w[i * nr_w + j];
-						}
-					}
+			int w_size = nr_feature;
+			if(model->bias >= 0){
+				w_size = nr_feature + 1;
+			}
+			int nr_w = model->nr_class;
+			if(model->nr_class == 2 && param.solver_type != lbf::liblinear::MCSVM_CS){
+				nr_w = 1;
+			}
+			ar & nr_feature;
+			ar & nr_w;
+			ar & w_size;
+			for(int i = 0;i < w_size;i++){
+				for(int j = 0;j < nr_w;j++){
+					ar & model->w[i * nr_w + j];
 				}
 			}
 		}
@@ -218,6 +745,27 @@ namespace lbf {
 			}
 			load_liblinear_models(ar, _linear_models_x_at_stage);
 			load_liblinear_models(ar, _linear_models_y_at_stage);
+
+			_pyramid_level_at_stage.assign(_num_stages, 0);
+			if(version > 0){
+				ar & _pyramid_level_at_stage;
+			}
+			_box_radius_at_stage.assign(_num_stages, 0);
+			if(version > 1){
+				ar & _box_radius_at_stage;
+			}
+			_bilinear_at_stage.assign(_num_stages, false);
+			if(version > 2){
+				ar & _bilinear_at_stage;
+			}
+
+			_inference_only = false;
+			_engine.init(_num_stages, _num_landmarks, _mean_shape.ptr<double>(0));
+			for(int stage = 0;stage < _num_stages;stage++){
+				if(_training_finished_at_stage[stage]){
+					_build_engine_stage(stage);
+				}
+			}
 		}
 		void Model::load_liblinear_models(boost::archive::binary_iarchive &ar, std::vector<std::vector<lbf::liblinear::model*>> &linear_models_at_stage){
 			linear_models_at_stage.clear();
@@ -230,42 +778,49 @@ namespace lbf {
 				linear_models.resize(_num_landmarks);
 
 				for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
-					bool skip_flag = true;
-					ar & skip_flag;
-					if(skip_flag){
-						continue;
-					}
+					linear_models[landmark_index] = load_liblinear_model(ar);
+				}
+			}
+		}
+		// returns NULL for a model that was not trained
+		lbf::liblinear::model* Model::load_liblinear_model(boost::archive::binary_iarchive &ar){
+			bool skip_flag = true;
+			ar & skip_flag;
+			if(skip_flag){
+				return NULL;
+			}
 
-					lbf::liblinear::model* model = new lbf::liblinear::model;
-					ar & model->param.solver_type;
-					ar & model->nr_class;
-					ar & model->bias;
-					
-					int nr_w = 0;
-					int w_size = 0;
-					ar & model->nr_feature;
-					ar & nr_w;
-					ar & w_size;
-					model->w = new double[w_size * nr_w];
-					for(int i = 0;i < w_size;i++){
-						for(int j = 0;j < nr_w;j++){
-							ar & model->w[i * nr_w + j];
-						}
-					}
-					linear_models[landmark_index] = model;
+			lbf::liblinear::model* model = new lbf::liblinear::model;
+			ar & model->param.solver_type;
+			ar & model->nr_class;
+			ar & model->bias;
+			model->nr_iter = 0;
+			
+			int nr_w = 0;
+			int w_size = 0;
+			ar & model->nr_feature;
+			ar & nr_w;
+			ar & w_size;
+			model->w = new double[w_size * nr_w];
+			for(int i = 0;i < w_size;i++){
+				for(int j = 0;j < nr_w;j++){
+					ar & model->w[i * nr_w + j];
 				}
 			}
+			return model;
 		}
+		// a crash while saving leaves the previous file intact
 		bool Model::python_save(std::string filename){
-			bool success = false;
-			std::ofstream ofs(filename);
-			if(ofs.good()){
-				boost::archive::binary_oarchive oarchive(ofs);
+			if(_inference_only){
+				PyErr_SetString(PyExc_ValueError, "an inference-only model has no training data to save");
+				boost::python::throw_error_already_set();
+			}
+			std::ostringstream stream;
+			{
+				boost::archive::binary_oarchive oarchive(stream);
 				oarchive << *this;
-				success = true;
 			}
-			ofs.close();
-			return success;
+			return write_file_atomically(filename, stream.str());
 		}
 		bool Model::python_load(std::string filename){
 			bool success = false;
@@ -278,65 +833,50 @@ namespace lbf {
 			ifs.close();
 			return success;
 		}
+		// flat model for the inference library
+		bool Model::python_save_inference_model(std::string filename){
+			return _engine.save(filename);
+		}
 		np::ndarray Model::python_estimate_shape(np::ndarray image_ndarray){
 			cv::Mat1b image = utils::ndarray_matrix_to_cv_matrix<uchar>(image_ndarray);
 			cv::Mat1d estimated_shape = _mean_shape.clone();
-
-			for(int stage = 0;stage < _num_stages;stage++){
-				if(_training_finished_at_stage[stage] == false){
-					continue;
-				}
-
-				struct liblinear::feature_node* binary_features = compute_binary_features_at_stage(image, estimated_shape, stage);
-
-				for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
-
-					struct liblinear::model* model_x = get_linear_model_x_at(stage, landmark_index);
-					struct liblinear::model* model_y = get_linear_model_y_at(stage, landmark_index);
-
-					assert(model_x != NULL);
-					assert(model_y != NULL);
-
-					double delta_x = liblinear::predict(model_x, binary_features);
-					double delta_y = liblinear::predict(model_y, binary_features);
-
-					estimated_shape(landmark_index, 0) += delta_x;
-					estimated_shape(landmark_index, 1) += delta_y;
-				}
-				delete[] binary_features;
+			{
+				ScopedGILRelease release;
+				infer::Workspace workspace;
+				set_image(workspace, image);
+				_engine.estimate_shape(infer::Transform(), estimated_shape.ptr<double>(0), workspace);
 			}
 
 			return utils::cv_matrix_to_ndarray_matrix(estimated_shape);
 		}
+		// stops after a stage that moves the landmarks by less than tolerance in total or once budget microseconds have passed.
+		// returns the shape and the number of stages that ran.
+		boost::python::tuple Model::python_estimate_shape_with_early_exit(np::ndarray image_ndarray, double tolerance, double budget){
+			cv::Mat1b image = utils::ndarray_matrix_to_cv_matrix<uchar>(image_ndarray);
+			cv::Mat1d estimated_shape(_num_landmarks, 2);
+			infer::EarlyExit early_exit;
+			early_exit.tolerance = tolerance;
+			early_exit.budget = budget;
+			int num_stages_run = 0;
+			{
+				ScopedGILRelease release;
+				infer::Workspace workspace;
+				num_stages_run = _engine.estimate_shape(image.data, image.cols, image.rows, image.step, estimated_shape.ptr<double>(0), workspace, early_exit);
+			}
+			return boost::python::make_tuple(utils::cv_matrix_to_ndarray_matrix(estimated_shape), num_stages_run);
+		}
 		boost::python::numpy::ndarray Model::python_estimate_shape_using_initial_shape(
 			boost::python::numpy::ndarray image_ndarray,
 			boost::python::numpy::ndarray initial_shape_ndarray)
 		{
 			cv::Mat1b image = utils::ndarray_matrix_to_cv_matrix<uchar>(image_ndarray);
 			cv::Mat1d estimated_shape = utils::ndarray_matrix_to_cv_matrix<double>(initial_shape_ndarray);
-
-			for(int stage = 0;stage < _num_stages;stage++){
-				if(_training_finished_at_stage[stage] == false){
-					continue;
-				}
-
-				struct liblinear::feature_node* binary_features = compute_binary_features_at_stage(image, estimated_shape, stage);
-
-				for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
-
-					struct liblinear::model* model_x = get_linear_model_x_at(stage, landmark_index);
-					struct liblinear::model* model_y = get_linear_model_y_at(stage, landmark_index);
-
-					assert(model_x != NULL);
-					assert(model_y != NULL);
-
-					double delta_x = liblinear::predict(model_x, binary_features);
-					double delta_y = liblinear::predict(model_y, binary_features);
-
-					estimated_shape(landmark_index, 0) += delta_x;
-					estimated_shape(landmark_index, 1) += delta_y;
-				}
-				delete[] binary_features;
+			assert(estimated_shape.rows == _num_landmarks && estimated_shape.cols == 2);
+			{
+				ScopedGILRelease release;
+				infer::Workspace workspace;
+				set_image(workspace, image);
+				_engine.estimate_shape(infer::Transform(), estimated_shape.ptr<double>(0), workspace);
 			}
 
 			return utils::cv_matrix_to_ndarray_matrix(estimated_shape);
@@ -351,39 +891,91 @@ namespace lbf {
 			cv::Mat1d rotation_inv = utils::ndarray_matrix_to_cv_matrix<double>(rotation_inv_ndarray);
 			cv::Mat1d shift_inv = utils::ndarray_vector_to_cv_matrix<double>(shift_inv_ndarray);
 			cv::Mat1d estimated_shape = _mean_shape.clone();
-			
-			for(int stage = 0;stage < _num_stages;stage++){
-				if(_training_finished_at_stage[stage] == false){
-					continue;
-				}
-
-				cv::Mat1d projected_estimated_shape = utils::project_shape(estimated_shape, rotation_inv, shift_inv);
-				struct liblinear::feature_node* binary_features = compute_binary_features_at_stage(image, projected_estimated_shape, stage);
-
-				for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
-
-					struct liblinear::model* model_x = get_linear_model_x_at(stage, landmark_index);
-					struct liblinear::model* model_y = get_linear_model_y_at(stage, landmark_index);
+			infer::Transform transform = build_transform(rotation_inv, cv::Point2d(shift_inv(0, 0), shift_inv(1, 0)));
+			{
+				ScopedGILRelease release;
+				infer::Workspace workspace;
+				set_image(workspace, image);
+				_engine.estimate_shape(transform, estimated_shape.ptr<double>(0), workspace);
+			}
 
-					assert(model_x != NULL);
-					assert(model_y != NULL);
+			return utils::cv_matrix_to_ndarray_matrix(estimated_shape);
+		}
+		// landmarks of every face box of a grayscale frame in frame pixel coordinates : (num_boxes, num_landmarks, 2).
+		// boxes are rows of (left, top, right, bottom) with right and bottom exclusive, or a single box of 4 values,
+		// and the entries of a box outside the frame are nan.
+		// the frame is read in place when it is a uint8 array whose rows are contiguous and do not overlap.
+		np::ndarray Model::python_estimate_shapes_in_frame(np::ndarray frame_ndarray, np::ndarray boxes_ndarray){
+			if(frame_ndarray.get_nd() != 2 || frame_ndarray.get_dtype() != np::dtype::get_builtin<uchar>()){
+				PyErr_SetString(PyExc_ValueError, "the frame must be a grayscale uint8 array of 2 dimensions");
+				boost::python::throw_error_already_set();
+			}
+			int boxes_nd = boxes_ndarray.get_nd();
+			if((boxes_nd == 2 && boxes_ndarray.get_shape()[1] != 4) || (boxes_nd == 1 && boxes_ndarray.shape(0) != 4 && boxes_ndarray.shape(0) != 0) || boxes_nd > 2){
+				PyErr_SetString(PyExc_ValueError, "boxes must be rows of (left, top, right, bottom)");
+				boost::python::throw_error_already_set();
+			}
+			auto size = frame_ndarray.get_shape();
+			auto stride = frame_ndarray.get_strides();
+			cv::Mat1b frame;
+			if(stride[1] == 1 && stride[0] >= size[1]){
+				frame = cv::Mat1b(size[0], size[1], reinterpret_cast<uchar*>(frame_ndarray.get_data()), stride[0]);	// no copy
+			}else{
+				frame = utils::ndarray_matrix_to_cv_matrix<uchar>(frame_ndarray);
+			}
 
-					double delta_x = liblinear::predict(model_x, binary_features);
-					double delta_y = liblinear::predict(model_y, binary_features);
+			int num_boxes = 0;
+			cv::Mat1d boxes;
+			if(boxes_nd == 1 && boxes_ndarray.shape(0) == 4){
+				boxes_ndarray = boxes_ndarray.reshape(boost::python::make_tuple(1, 4));
+				boxes_nd = 2;
+			}
+			if(boxes_nd == 2 && boxes_ndarray.get_shape()[0] > 0){
+				np::ndarray boxes_double_ndarray = boxes_ndarray.astype(np::dtype::get_builtin<double>());
+				boxes = utils::ndarray_matrix_to_cv_matrix<double>(boxes_double_ndarray);
+				num_boxes = boxes.rows;
+			}
+			// the coordinates are clamped to the frame before they are cast to int, as the engine would clamp them
+			for(int box_index = 0;box_index < num_boxes;box_index++){
+				for(int k = 0;k < 4;k++){
+					double &value = boxes(box_index, k);
+					if(std::isfinite(value) == false){
+						PyErr_SetString(PyExc_ValueError, "boxes must be finite");
+						boost::python::throw_error_already_set();
+					}
+					value = std::min(std::max(value, 0.0), (double)((k % 2 == 0) ? frame.cols : frame.rows));
+				}
+			}
 
-					estimated_shape(landmark_index, 0) += delta_x;
-					estimated_shape(landmark_index, 1) += delta_y;
+			int num_values = _num_landmarks * 2;
+			cv::Mat1d shapes(num_boxes, num_values);
+			{
+				ScopedGILRelease release;
+				infer::Workspace workspace;
+				for(int box_index = 0;box_index < num_boxes;box_index++){
+					double* shape = shapes.ptr<double>(box_index);
+					bool success = _engine.estimate_shape_in_box(frame.data, frame.cols, frame.rows, frame.step,
+																 boxes(box_index, 0), boxes(box_index, 1), boxes(box_index, 2), boxes(box_index, 3),
+																 shape, workspace);
+					if(success == false){
+						std::fill(shape, shape + num_values, NAN);
+					}
 				}
-				delete[] binary_features;
 			}
 
-			return utils::cv_matrix_to_ndarray_matrix(estimated_shape);
+			boost::python::tuple shape_size = boost::python::make_tuple(num_boxes, _num_landmarks, 2);
+			np::ndarray shapes_ndarray = np::zeros(shape_size, np::dtype::get_builtin<double>());
+			if(num_boxes > 0){
+				std::copy(shapes.ptr<double>(0), shapes.ptr<double>(0) + num_boxes * num_values, reinterpret_cast<double*>(shapes_ndarray.get_data()));
+			}
+			return shapes_ndarray;
 		}
 		np::ndarray Model::python_get_mean_shape(){
 			return utils::cv_matrix_to_ndarray_matrix(_mean_shape);
 		}
-		struct liblinear::feature_node* Model::compute_binary_features_at_stage(cv::Mat1b &image, cv::Mat1d &shape, int stage){
+		struct liblinear::feature_node* Model::compute_binary_features_at_stage(FaceImage &face_image, cv::Mat1d &shape, int stage){
 			assert(shape.rows == _num_landmarks && shape.cols == 2);
+			int level = get_pyramid_level_at_stage(stage);
 			
 			int num_total_trees = 0;
 			int num_total_leaves = 0;
@@ -400,17 +992,15 @@ namespace lbf {
 			for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
 				// find leaves
 				Forest* forest = get_forest(stage, landmark_index);
-				std::vector<Node*> leaves;
-				forest->predict(shape, image, leaves);
-				assert(leaves.size() == forest->get_num_trees());
+				std::vector<int> leaf_identifiers;
+				forest->predict(shape, face_image, level, leaf_identifiers);
+				assert(leaf_identifiers.size() == forest->get_num_trees());
 				// delta_shape
 				for(int tree_index = 0;tree_index < forest->get_num_trees();tree_index++){
 					Tree* tree = forest->get_tree_at(tree_index);
-					int num_leaves = tree->get_num_leaves();
-					Node* leaf = leaves[tree_index];
 					assert(feature_pointer < num_total_trees + 1);
 					liblinear::feature_node &feature = binary_features[feature_pointer];
-					feature.index = feature_offset + leaf->identifier();
+					feature.index = feature_offset + leaf_identifiers[tree_index];
 					feature.value = 1.0;	// binary feature
 					feature_pointer++;
 					feature_offset += tree->get_num_leaves();
@@ -421,6 +1011,14 @@ namespace lbf {
 			feature.value = -1;
 			return binary_features;
 		}
+		// fused feature extraction and global regression of the engine.
+		// gives the same result as compute_binary_features_at_stage followed by liblinear::predict for every landmark.
+		void Model::estimate_shape_at_stage(infer::Workspace &workspace, const infer::Transform &transform, int stage, cv::Mat1d &estimated_shape){
+			assert(estimated_shape.rows == _num_landmarks && estimated_shape.cols == 2);
+			assert(estimated_shape.isContinuous());
+			assert(_training_finished_at_stage[stage] == true);
+			_engine.estimate_shape_at_stage(stage, transform, estimated_shape.ptr<double>(0), workspace);
+		}
 		boost::python::list Model::python_compute_error(np::ndarray image_ndarray, 
 													    np::ndarray normalized_target_shape_ndarray, 
 													    np::ndarray rotation_inv_ndarray, 
@@ -431,7 +1029,11 @@ namespace lbf {
 			cv::Mat1d target_shape = utils::ndarray_matrix_to_cv_matrix<double>(normalized_target_shape_ndarray);
 			cv::Mat1d rotation_inv = utils::ndarray_matrix_to_cv_matrix<double>(rotation_inv_ndarray);
 			cv::Mat1d shift_inv = utils::ndarray_vector_to_cv_matrix<double>(shift_inv_ndarray);
-			std::vector<double> error_at_stage = compute_error(image, target_shape, rotation_inv, shift_inv, normalized_pupil_distance);
+			std::vector<double> error_at_stage;
+			{
+				ScopedGILRelease release;
+				error_at_stage = compute_error(image, target_shape, rotation_inv, shift_inv, normalized_pupil_distance);
+			}
 			return boost::python::vector_to_list(error_at_stage);
 		}
 		std::vector<double> Model::compute_error(cv::Mat1b &image, 
@@ -444,6 +1046,9 @@ namespace lbf {
 			assert(rotation_inv.rows == 2 && rotation_inv.cols == 2);
 			assert(shift_inv.rows == 2 && shift_inv.cols == 1);
 
+			infer::Workspace workspace;
+			set_image(workspace, image);
+			infer::Transform transform = build_transform(rotation_inv, cv::Point2d(shift_inv(0, 0), shift_inv(1, 0)));
 			cv::Mat1d estimated_shape = _mean_shape.clone();
 			std::vector<double> error_at_stage;
 
@@ -452,34 +1057,23 @@ namespace lbf {
 					continue;
 				}
 
-				cv::Mat1d projected_estimated_shape = utils::project_shape(estimated_shape, rotation_inv, shift_inv);
-				struct liblinear::feature_node* binary_features = compute_binary_features_at_stage(image, projected_estimated_shape, stage);
-				double error = 0;
-
-				for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
-
-					struct liblinear::model* model_x = get_linear_model_x_at(stage, landmark_index);
-					struct liblinear::model* model_y = get_linear_model_y_at(stage, landmark_index);
-
-					assert(model_x != NULL);
-					assert(model_y != NULL);
+				estimate_shape_at_stage(workspace, transform, stage, estimated_shape);
 
-					double delta_x = liblinear::predict(model_x, binary_features);
-					double delta_y = liblinear::predict(model_y, binary_features);
-
-					// update shape
-					estimated_shape(landmark_index, 0) += delta_x;
-					estimated_shape(landmark_index, 1) += delta_y;
-
-					// compute error
-					double error_x = target_shape(landmark_index, 0) - estimated_shape(landmark_index, 0);
-					double error_y = target_shape(landmark_index, 1) - estimated_shape(landmark_index, 1);
-					error += std::sqrt(error_x * error_x + error_y * error_y);
-				}
-				error_at_stage.push_back(error / _num_landmarks / normalized_pupil_distance * 100);
-				delete[] binary_features;
+				error_at_stage.push_back(compute_mean_error(target_shape, estimated_shape, normalized_pupil_distance));
 			}
 			return error_at_stage;
 		}
+		// mean distance of the landmarks as a percentage of the pupil distance
+		double Model::compute_mean_error(cv::Mat1d &target_shape, cv::Mat1d &estimated_shape, double normalized_pupil_distance){
+			assert(target_shape.rows == _num_landmarks && target_shape.cols == 2);
+			assert(estimated_shape.rows == _num_landmarks && estimated_shape.cols == 2);
+			double error = 0;
+			for(int landmark_index = 0;landmark_index < _num_landmarks;landmark_index++){
+				double error_x = target_shape(landmark_index, 0) - estimated_shape(landmark_index, 0);
+				double error_y = target_shape(landmark_index, 1) - estimated_shape(landmark_index, 1);
+				error += std::sqrt(error_x * error_x + error_y * error_y);
+			}
+			return error / _num_landmarks / normalized_pupil_distance * 100;
+		}
 	}
 }
\ No newline at end of file
@@ -4,12 +4,34 @@
 #include <boost/serialization/serialization.hpp>
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/binary_oarchive.hpp>
+#include <boost/serialization/version.hpp>
 #include <vector>
+#include "../infer/engine.h"
+#include "corpus.h"
+#include "../lbf/face_image.h"
 #include "../lbf/liblinear/linear.h"
 #include "../lbf/randomforest/forest.h"
 
 namespace lbf {
 	namespace python {
+		// a tree that prune removed, or with tree_index -1 a whole forest, and the validation error once it was gone
+		struct PrunedTree {
+			int stage;
+			int landmark_index;
+			int tree_index;		// in the forest before pruning
+			double error;
+		};
+		struct PruneReport {
+			double error_before;		// mean validation error in % of the pupil distance
+			double error_after;
+			double time_before;			// microseconds per face on one thread
+			double time_after;
+			int num_removed_trees;		// the trees of removed forests included
+			std::vector<PrunedTree> removed;
+		};
+		// estimate_shape*, compute_error and get_mean_shape only read the model and release the GIL while they compute,
+		// so a loaded model can be shared by any number of Python threads.
+		// the setters, load and training modify it and must not run concurrently with anything else.
 		class Model {
 		private:
 			friend class boost::serialization::access;
@@ -20,47 +42,85 @@ namespace lbf {
 			void load(boost::archive::binary_iarchive &archive, unsigned int version);
 			void load_liblinear_models(boost::archive::binary_iarchive &ar, std::vector<std::vector<lbf::liblinear::model*>> &linear_models_at_stage);
 			void _init(int num_stages, int num_trees_per_forest, int tree_depth, int num_landmarks, boost::python::numpy::ndarray &mean_shape_ndarray, std::vector<double> &feature_radius);
+			void _build_engine_stage(int stage);
+			void _load_inference_model(std::string filename);
+			void _check_trainable();
+			void _set_leaf_rows(int stage, int first_leaf, int num_leaves, bool zero);
+			double _compute_validation_error(Corpus* corpus, int first_stage, const std::vector<cv::Mat1d> &shapes);
+			void _apply_stage(Corpus* corpus, int stage, std::vector<cv::Mat1d> &shapes);
+			double _measure_time_per_face(Corpus* corpus);
 		public:
 			int _num_stages;
 			int _num_trees_per_forest;
 			int _num_landmarks;
 			int _tree_depth;
 			std::vector<double> _local_radius_at_stage;
+			std::vector<int> _pyramid_level_at_stage;		// pixel features of each stage are read from this pyramid level
+			std::vector<double> _box_radius_at_stage;		// > 0 : the stage uses box features of this radius
+			std::vector<bool> _bilinear_at_stage;			// the pixel features of the stage are interpolated
 			std::vector<bool> _training_finished_at_stage;
 			std::vector<std::vector<randomforest::Forest*>> _forest_at_stage;
 			std::vector<std::vector<lbf::liblinear::model*>> _linear_models_x_at_stage;
 			std::vector<std::vector<lbf::liblinear::model*>> _linear_models_y_at_stage;
+			infer::Engine _engine;		// flattened trees and leaf-major regression tables of the finished stages
+			bool _inference_only;		// loaded from a file of save_inference_model : no forests and no liblinear models
 			cv::Mat1d _mean_shape;
 			Model(int num_stages, int num_trees_per_forest, int tree_depth, int num_landmarks, boost::python::numpy::ndarray mean_shape_ndarray, boost::python::list feature_radius);
 			Model(int num_stages, int num_trees_per_forest, int tree_depth, int num_landmarks, boost::python::numpy::ndarray mean_shape_ndarray, std::vector<double> &feature_radius);
-			Model(std::string filename);
+			// inference_only maps a file written by save_inference_model, which has none of the training data.
+			// such a model estimates shapes but can not be trained or saved with save.
+			Model(std::string filename, bool inference_only = false);
 			~Model();
 			randomforest::Forest* get_forest(int stage, int landmark_index);
 			lbf::liblinear::model* get_linear_model_x_at(int stage, int landmark_index);
 			lbf::liblinear::model* get_linear_model_y_at(int stage, int landmark_index);
 			void set_linear_models(lbf::liblinear::model* model_x, lbf::liblinear::model* model_y, int stage, int landmark_index);
 			void set_num_stages(int num_stages);
+			void set_complete_trees(bool complete);
+			void set_split_sampling(int num_features_per_node, int max_split_samples);
+			void set_image_pyramid(int num_levels);
+			int get_pyramid_level_at_stage(int stage);
+			int get_num_pyramid_levels();
+			void set_box_features(int stage, double box_radius);
+			bool use_box_features();
+			void set_bilinear_features(int stage, bool bilinear);
+			FaceImage build_face_image(cv::Mat1b &image);
+			void set_image(infer::Workspace &workspace, cv::Mat1b &image);
+			infer::Transform build_transform(cv::Mat1d &rotation, cv::Point2d shift);
 			void finish_training_at_stage(int stage);
+			void update_engine_weights(int stage);
+			PruneReport prune(Corpus* corpus, double tolerance);
+			boost::python::dict python_prune(Corpus* corpus, double tolerance);
+			void save_liblinear_model(boost::archive::binary_oarchive &ar, const lbf::liblinear::model* model) const;
+			lbf::liblinear::model* load_liblinear_model(boost::archive::binary_iarchive &ar);
 			bool python_save(std::string filename);
 			bool python_load(std::string filename);
+			bool python_save_inference_model(std::string filename);
 			boost::python::list python_compute_error(boost::python::numpy::ndarray image_ndarray, 
 													 boost::python::numpy::ndarray normalized_target_shape_ndarray, 
 													 boost::python::numpy::ndarray rotation_inv_ndarray, 
 													 boost::python::numpy::ndarray shift_inv_ndarray,
 													 double normalized_pupil_distance);
+			double compute_mean_error(cv::Mat1d &target_shape, cv::Mat1d &estimated_shape, double normalized_pupil_distance);
 			std::vector<double> compute_error(cv::Mat1b &image, 
 											  cv::Mat1d &target_shape, 
 											  cv::Mat1d &rotation_inv, 
 											  cv::Mat1d &shift_inv,
 											  double normalized_pupil_distance);
 			boost::python::numpy::ndarray python_estimate_shape(boost::python::numpy::ndarray image_ndarray);
+			boost::python::tuple python_estimate_shape_with_early_exit(boost::python::numpy::ndarray image_ndarray, double tolerance, double budget);
 			boost::python::numpy::ndarray python_estimate_shape_using_initial_shape(boost::python::numpy::ndarray image_ndarray,
 																					boost::python::numpy::ndarray initial_shape_ndarray);
 			boost::python::numpy::ndarray python_estimate_shape_by_translation(boost::python::numpy::ndarray image_ndarray, 
 																			   boost::python::numpy::ndarray rotation_inv_ndarray, 
 																			   boost::python::numpy::ndarray shift_inv_ndarray);
+			boost::python::numpy::ndarray python_estimate_shapes_in_frame(boost::python::numpy::ndarray frame_ndarray, 
+																		  boost::python::numpy::ndarray boxes_ndarray);
 			boost::python::numpy::ndarray python_get_mean_shape();
-			struct liblinear::feature_node* compute_binary_features_at_stage(cv::Mat1b &image, cv::Mat1d &shape, int stage);
+			struct liblinear::feature_node* compute_binary_features_at_stage(FaceImage &face_image, cv::Mat1d &shape, int stage);
+			void estimate_shape_at_stage(infer::Workspace &workspace, const infer::Transform &transform, int stage, cv::Mat1d &estimated_shape);
 		};
 	}
-}
\ No newline at end of file
+}
+
+BOOST_CLASS_VERSION(lbf::python::Model, 3)
\ No newline at end of file
@@ -2,11 +2,21 @@
 #ifdef _OPENMP
 #include <omp.h>
 #endif
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/serialization/string.hpp>
+#include <chrono>
 #include <cmath>
 #include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 #include "../lbf/liblinear/linear.h"
 #include "../lbf/sampler.h"
 #include "../lbf/randomforest/forest.h"
+#include "cluster.h"
+#include "gil.h"
 #include "trainer.h"
 
 using std::cout;
@@ -19,11 +29,19 @@ namespace np = boost::python::numpy;
 namespace lbf {
 	namespace python {
 		Trainer::Trainer(Corpus* training_corpus, Corpus* validation_corpus, Model* model, int augmentation_size, int num_features_to_sample){
+			if(model->_inference_only){
+				PyErr_SetString(PyExc_ValueError, "This model was loaded with inference_only and can not be trained.");
+				boost::python::throw_error_already_set();
+			}
 			_training_corpus = training_corpus;
 			_validation_corpus = validation_corpus;
 			_model = model;
 			_num_features_to_sample = num_features_to_sample;
 			_augmentation_size = augmentation_size;
+			_num_applied_stages = 0;
+			_warm_start_model = NULL;
+			_cluster_coordinator = false;
+			_cluster_timeout = 3600;
 
 			std::cout << "augmentation_size = " << augmentation_size << std::endl;
 			std::cout << "num_features_to_sample = " << num_features_to_sample << std::endl;
@@ -85,12 +103,36 @@ namespace lbf {
 				}
 			}
 
+			_forest_restored_at_stage.assign(model->_num_stages, std::vector<bool>(num_landmarks, false));
+			_regressors_restored_at_stage.assign(model->_num_stages, std::vector<bool>(num_landmarks, false));
 		}
 		cv::Mat1b & Trainer::get_image_by_augmented_index(int augmented_data_index){
 			assert(augmented_data_index < _augmented_indices_to_data_index.size());
 			int data_index = get_data_index_by_augmented_index(augmented_data_index);
 			return _training_corpus->_images[data_index];
 		}
+		FaceImage & Trainer::get_face_image_by_augmented_index(int augmented_data_index){
+			int data_index = get_data_index_by_augmented_index(augmented_data_index);
+			assert(data_index < _training_face_images.size());
+			return _training_face_images[data_index];
+		}
+		// pyramids of the training images, rebuilt only when the model asks for more levels or integral images
+		void Trainer::_build_face_images(){
+			int num_levels = _model->get_num_pyramid_levels();
+			bool integral = _model->use_box_features();
+			int num_data = _training_corpus->get_num_images();
+			if(_training_face_images.size() == num_data && num_data > 0){
+				FaceImage &face_image = _training_face_images[0];
+				if(face_image.get_num_levels() >= num_levels && (face_image.has_integrals() || integral == false)){
+					return;
+				}
+			}
+			_training_face_images.resize(num_data);
+			#pragma omp parallel for
+			for(int data_index = 0;data_index < num_data;data_index++){
+				_training_face_images[data_index] = _model->build_face_image(_training_corpus->get_image(data_index));
+			}
+		}
 		int Trainer::get_data_index_by_augmented_index(int augmented_data_index){
 			assert(augmented_data_index < _augmented_indices_to_data_index.size());
 			return _augmented_indices_to_data_index[augmented_data_index];
@@ -102,10 +144,29 @@ namespace lbf {
 		}
 		void Trainer::train_stage(int stage){
 			cout << "training stage: " << (stage + 1) << " of " << _model->_num_stages << endl;
+			if(stage < _num_applied_stages){
+				cout << "restored from the journal." << endl;
+				return;
+			}
+			_build_face_images();
+			_cluster_error.clear();
+
+			// the cached validation shapes of this stage and later ones are no longer valid
+			if(stage < _validation_error_at_stage.size()){
+				_validation_error_at_stage.resize(stage);
+				_validation_estimated_shapes_at_stage.resize(stage);
+			}
 
 			// local binary features
 			if(_model->_training_finished_at_stage[stage] == false){
-				train_local_feature_mapping_functions(stage);
+				_forests_reused_at_stage.resize(_model->_num_stages, false);
+				_forests_reused_at_stage[stage] = _reuse_warm_start_forests(stage);
+				if(_forests_reused_at_stage[stage] == false){
+					train_local_feature_mapping_functions(stage);
+				}
+				if(_cluster_error.empty() == false){
+					throw std::runtime_error(_cluster_error);
+				}
 			}
 
 			cout << "generating binary features ..." << endl;
@@ -113,16 +174,23 @@ namespace lbf {
 			#pragma omp parallel for
 			for(int augmented_data_index = 0;augmented_data_index < _num_augmented_data;augmented_data_index++){
 
-				cv::Mat1b &image = get_image_by_augmented_index(augmented_data_index);
+				FaceImage &face_image = get_face_image_by_augmented_index(augmented_data_index);
 				cv::Mat1d projected_shape = project_current_estimated_shape(augmented_data_index);
 
-				binary_features[augmented_data_index] = _model->compute_binary_features_at_stage(image, projected_shape, stage);
+				binary_features[augmented_data_index] = _model->compute_binary_features_at_stage(face_image, projected_shape, stage);
 			}
 			
 			// global linear regression
 			if(_model->_training_finished_at_stage[stage] == false){
 				train_global_linear_regression_at_stage(stage, binary_features);
 			}
+			if(_cluster_error.empty() == false){
+				for(int augmented_data_index = 0;augmented_data_index < _num_augmented_data;augmented_data_index++){
+					delete[] binary_features[augmented_data_index];
+				}
+				delete[] binary_features;
+				throw std::runtime_error(_cluster_error);
+			}
 			
 			_model->finish_training_at_stage(stage);
 				
@@ -174,6 +242,9 @@ namespace lbf {
 				delete[] binary_features[augmented_data_index];
 			}
 			delete[] binary_features;
+
+			_num_applied_stages = stage + 1;
+			_write_state();
 		}
 		void Trainer::train_global_linear_regression_at_stage(int stage, struct liblinear::feature_node** binary_features){
 			int num_total_trees = 0;
@@ -190,22 +261,49 @@ namespace lbf {
 			problem->l = _num_augmented_data;
 			problem->n = num_total_leaves;
 			problem->x = binary_features;
+			problem->y = NULL;
 			problem->bias = -1;
+			problem->binary = 1;
 
-			struct liblinear::parameter* parameter = new struct liblinear::parameter;
+			struct liblinear::parameter* parameter = new struct liblinear::parameter();
 			parameter->solver_type = liblinear::L2R_L2LOSS_SVR_DUAL;
 			parameter->C = 0.00001;
 			parameter->p = 0;
+			parameter->eps = 0.001;		// reaches the objective of 1000 passes within a few passes
 
 		    double** targets = new double*[_model->_num_landmarks];
 			for(int landmark_index = 0;landmark_index < _model->_num_landmarks;landmark_index++){
 				targets[landmark_index] = new double[_num_augmented_data];
 			}
 
+			// every regressor shuffles with its own seed, so the result does not depend on the thread that trains it
+			// and a resumed stage trains the remaining regressors like an uninterrupted one
+			std::vector<unsigned int> seeds(_model->_num_landmarks * 2);
+			for(int seed_index = 0;seed_index < seeds.size();seed_index++){
+				seeds[seed_index] = sampler::uniform_int(0, std::numeric_limits<int>::max());
+			}
+
 			// train regressor
 			cout << "training global linear regressors ..." << endl;
-			#pragma omp parallel for
+			auto start = std::chrono::steady_clock::now();
+			int num_trained_regressors = 0;
+			int num_warm_started_regressors = 0;
+			int num_total_iterations = 0;
+			std::vector<int> pending(_model->_num_landmarks, CLAIMED);		// CLAIMED_BY_OTHER : trained by another process
+			#pragma omp parallel for schedule(dynamic) reduction(+:num_trained_regressors, num_warm_started_regressors, num_total_iterations)
 			for(int landmark_index = 0;landmark_index < _model->_num_landmarks;landmark_index++){
+				if(_regressors_restored_at_stage[stage][landmark_index]){
+					continue;
+				}
+				int claim = _claim(REGRESSORS_RECORD, stage, landmark_index);
+				if(claim != CLAIMED){
+					pending[landmark_index] = claim;
+					continue;
+				}
+				// the features are shared but the targets and the seed are per call
+				struct liblinear::problem landmark_problem = *problem;
+				struct liblinear::parameter landmark_parameter = *parameter;
+				landmark_problem.y = targets[landmark_index];
 				// train x
 				for(int augmented_data_index = 0;augmented_data_index < _num_augmented_data;augmented_data_index++){
 					cv::Mat1d &target_shape = _augmented_target_shapes[augmented_data_index];
@@ -218,9 +316,12 @@ namespace lbf {
 
 					targets[landmark_index][augmented_data_index] = delta_x;
 				}
-				problem->y = targets[landmark_index];
-				liblinear::check_parameter(problem, parameter);
-		        struct liblinear::model* model_x = liblinear::train(problem, parameter);
+				landmark_parameter.seed = seeds[landmark_index * 2 + 0];
+				landmark_parameter.init_sol = _get_warm_start_weights(_warm_start_model, stage, landmark_index, 0, num_total_leaves);
+				liblinear::check_parameter(&landmark_problem, &landmark_parameter);
+		        struct liblinear::model* model_x = liblinear::train(&landmark_problem, &landmark_parameter);
+				num_warm_started_regressors += (landmark_parameter.init_sol != NULL) ? 1 : 0;
+				num_total_iterations += model_x->nr_iter;
 
 				// train y
 				for(int augmented_data_index = 0;augmented_data_index < _num_augmented_data;augmented_data_index++){
@@ -234,15 +335,30 @@ namespace lbf {
 
 					targets[landmark_index][augmented_data_index] = delta_y;
 				}
-				problem->y = targets[landmark_index];
-				liblinear::check_parameter(problem, parameter);
-		        struct liblinear::model* model_y = liblinear::train(problem, parameter);
+				landmark_parameter.seed = seeds[landmark_index * 2 + 1];
+				landmark_parameter.init_sol = _get_warm_start_weights(_warm_start_model, stage, landmark_index, 1, num_total_leaves);
+				liblinear::check_parameter(&landmark_problem, &landmark_parameter);
+		        struct liblinear::model* model_y = liblinear::train(&landmark_problem, &landmark_parameter);
+				num_warm_started_regressors += (landmark_parameter.init_sol != NULL) ? 1 : 0;
+				num_total_iterations += model_y->nr_iter;
+				num_trained_regressors += 2;
 
 		        _model->set_linear_models(model_x, model_y, stage, landmark_index);
+				if(_journal_filename.empty() == false || _cluster_directory.empty() == false){
+					JournalRecord record = _get_regressors_record(stage, landmark_index);
+					_journal(record);
+					_publish(record);
+				}
 				cout << "." << flush;
 			}
 
 			cout << endl;
+			if(num_trained_regressors > 0){
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				cout << "#passes = " << (double)num_total_iterations / num_trained_regressors << " on average (";
+				cout << num_warm_started_regressors << " of " << num_trained_regressors << " regressors warm-started) in " << seconds << " s" << endl;
+			}
+			_collect_results(REGRESSORS_RECORD, stage, pending);
 
 			for(int landmark_index = 0;landmark_index < _model->_num_landmarks;landmark_index++){
 				delete[] targets[landmark_index];
@@ -251,14 +367,100 @@ namespace lbf {
 			delete problem;
 			delete parameter;
 		}
+		// the stages of the previous model that match the ones of this model keep its forests,
+		// so their regressors can start from its weights
+		void Trainer::set_warm_start_model(Model* model){
+			if(model != NULL && (model->_inference_only || model->_num_landmarks != _model->_num_landmarks)){
+				PyErr_SetString(PyExc_ValueError, "The warm start model needs the liblinear models of the same landmarks.");
+				boost::python::throw_error_already_set();
+			}
+			if(model != NULL && (model->_num_trees_per_forest != _model->_num_trees_per_forest || model->_tree_depth != _model->_tree_depth)){
+				PyErr_SetString(PyExc_ValueError, "The warm start model needs forests of the same number of trees and depth.");
+				boost::python::throw_error_already_set();
+			}
+			_warm_start_model = model;
+		}
+		// leaf i of a newly trained stage has nothing to do with leaf i of the previous model,
+		// so the regressors only start from its weights when the stage is made of its forests
+		bool Trainer::_reuse_warm_start_forests(int stage){
+			Model* model = _warm_start_model;
+			if(model == NULL){
+				return false;
+			}
+			if(stage >= model->_num_stages || model->_training_finished_at_stage[stage] == false
+			   || model->_local_radius_at_stage[stage] != _model->_local_radius_at_stage[stage]
+			   || model->get_pyramid_level_at_stage(stage) != _model->get_pyramid_level_at_stage(stage)
+			   || model->_box_radius_at_stage[stage] != _model->_box_radius_at_stage[stage]
+			   || model->_bilinear_at_stage[stage] != _model->_bilinear_at_stage[stage]){
+				cout << "the warm start model has no forests of this stage, the regressors start from 0." << endl;
+				return false;
+			}
+			for(int landmark_index = 0;landmark_index < _model->_num_landmarks;landmark_index++){
+				if(_forest_restored_at_stage[stage][landmark_index]){
+					cout << "the forests of this stage were restored, the regressors start from 0." << endl;
+					return false;
+				}
+			}
+			cout << "reusing the forests of the warm start model ..." << endl;
+			for(int landmark_index = 0;landmark_index < _model->_num_landmarks;landmark_index++){
+				std::ostringstream ostream;
+				{
+					boost::archive::binary_oarchive oarchive(ostream);
+					Forest* forest = model->get_forest(stage, landmark_index);
+					oarchive << forest;
+				}
+				std::istringstream istream(ostream.str());
+				boost::archive::binary_iarchive iarchive(istream);
+				Forest* forest = NULL;
+				iarchive >> forest;
+				delete _model->_forest_at_stage[stage][landmark_index];
+				_model->_forest_at_stage[stage][landmark_index] = forest;
+			}
+			return true;
+		}
+		double* Trainer::_get_warm_start_weights(Model* model, int stage, int landmark_index, int axis, int num_total_leaves){
+			if(model == NULL || _forests_reused_at_stage[stage] == false){
+				return NULL;
+			}
+			liblinear::model* linear_model = (axis == 0) ? model->get_linear_model_x_at(stage, landmark_index) : model->get_linear_model_y_at(stage, landmark_index);
+			if(linear_model == NULL){
+				return NULL;
+			}
+			assert(linear_model->nr_feature == num_total_leaves);
+			return linear_model->w;
+		}
 		void Trainer::train_local_feature_mapping_functions(int stage){
 			cout << "training local feature mapping functions ..." << endl;
-			#pragma omp parallel for
+			// every forest draws from its own generator, so it does not depend on the thread that trains it
+			// and a resumed stage trains the remaining forests like an uninterrupted one
+			std::vector<int> seeds(_model->_num_landmarks);
+			for(int landmark_index = 0;landmark_index < _model->_num_landmarks;landmark_index++){
+				seeds[landmark_index] = sampler::uniform_int(0, std::numeric_limits<int>::max());
+			}
+			std::string state = sampler::get_state();
+			std::vector<int> pending(_model->_num_landmarks, CLAIMED);		// CLAIMED_BY_OTHER : trained by another process
+			#pragma omp parallel for schedule(dynamic)
 			for(int landmark_index = 0;landmark_index < _model->_num_landmarks;landmark_index++){
+				if(_forest_restored_at_stage[stage][landmark_index]){
+					continue;
+				}
+				int claim = _claim(FOREST_RECORD, stage, landmark_index);
+				if(claim != CLAIMED){
+					pending[landmark_index] = claim;
+					continue;
+				}
+				sampler::set_seed(seeds[landmark_index]);
 				_train_forest(stage, landmark_index);
+				if(_journal_filename.empty() == false || _cluster_directory.empty() == false){
+					JournalRecord record = _get_forest_record(stage, landmark_index);
+					_journal(record);
+					_publish(record);
+				}
 				cout << "." << flush;
 			}
 			cout << endl;
+			sampler::set_state(state);
+			_collect_results(FOREST_RECORD, stage, pending);
 		}
 		void Trainer::_train_forest(int stage, int landmark_index){
 			Corpus* corpus = _training_corpus;
@@ -267,6 +469,22 @@ namespace lbf {
 			std::vector<FeatureLocation> sampled_feature_locations = _sampled_feature_locations_at_stage[stage];
 			assert(sampled_feature_locations.size() == _num_features_to_sample);
 
+			// feature type of the stage
+			double box_radius = _model->_box_radius_at_stage[stage];
+			bool bilinear = _model->_bilinear_at_stage[stage];
+			for(FeatureLocation &location: sampled_feature_locations){
+				location.type = (box_radius > 0) ? BOX_FEATURE : (bilinear ? BILINEAR_FEATURE : PIXEL_FEATURE);
+				location.box_radius = box_radius;
+			}
+			// pixel features are read in batches
+			infer::PixelDifferenceSampler sampler;
+			sampler.set_bilinear(bilinear);
+			if(box_radius <= 0){
+				for(FeatureLocation &location: sampled_feature_locations){
+					sampler.add_feature(location.a.x, location.a.y, location.b.x, location.b.y);
+				}
+			}
+
 			int num_data = corpus->_images.size();
 			int augmentation_size = _augmentation_size;
 
@@ -274,10 +492,11 @@ namespace lbf {
 			cv::Mat_<int> pixel_differences(_num_features_to_sample, _num_augmented_data);
 
 			// get pixel differences
+			int level = _model->get_pyramid_level_at_stage(stage);
 			for(int augmented_data_index = 0;augmented_data_index < _num_augmented_data;augmented_data_index++){
-				cv::Mat1b &image = get_image_by_augmented_index(augmented_data_index);
+				FaceImage &face_image = get_face_image_by_augmented_index(augmented_data_index);
 				cv::Mat1d projected_shape = project_current_estimated_shape(augmented_data_index);
-				_compute_pixel_differences(projected_shape, image, pixel_differences, sampled_feature_locations, augmented_data_index, landmark_index);
+				_compute_pixel_differences(projected_shape, face_image, level, pixel_differences, sampled_feature_locations, sampler, augmented_data_index, landmark_index);
 			}
 
 			// compute ground truth shape increment	
@@ -296,9 +515,11 @@ namespace lbf {
 			forest->train(sampled_feature_locations, pixel_differences, regression_targets_of_data);
 		}
 		void Trainer::_compute_pixel_differences(cv::Mat1d &shape, 
-												 cv::Mat1b &image, 
+												 FaceImage &face_image, 
+												 int level,
 												 cv::Mat_<int> &pixel_differences, 
 												 std::vector<FeatureLocation> &sampled_feature_locations,
+												 const infer::PixelDifferenceSampler &sampler,
 												 int data_index, 
 												 int landmark_index)
 		{
@@ -306,39 +527,23 @@ namespace lbf {
 			assert(pixel_differences.rows == _num_features_to_sample && pixel_differences.cols == _num_augmented_data);
 			assert(sampled_feature_locations.size() == _num_features_to_sample);
 
-			int image_height = image.rows;
-			int image_width = image.cols;
-
 			double landmark_x = shape(landmark_index, 0);	// [-1, 1] : origin is the center of the image
 			double landmark_y = shape(landmark_index, 1);	// [-1, 1] : origin is the center of the image
 
+			if(sampler.get_num_features() > 0){
+				assert(sampler.get_num_features() == _num_features_to_sample);
+				std::vector<int> differences(_num_features_to_sample);
+				face_image.compute_pixel_differences(level, landmark_x, landmark_y, sampler, differences.data());
+				for(int feature_index = 0;feature_index < _num_features_to_sample;feature_index++){
+					pixel_differences(feature_index, data_index) = differences[feature_index];
+				}
+				return;
+			}
 			for(int feature_index = 0;feature_index < _num_features_to_sample;feature_index++){
 				FeatureLocation &local_location = sampled_feature_locations[feature_index]; // origin is the landmark position
 
-				// a
-				double local_x_a = local_location.a.x + landmark_x;	// [-1, 1] : origin is the center of the image
-				double local_y_a = local_location.a.y + landmark_y;
-				int pixel_x_a = (image_width / 2.0) + local_x_a * (image_width / 2.0);	// [0, image_width]
-				int pixel_y_a = (image_height / 2.0) + local_y_a * (image_height / 2.0);
-
-				// b
-				double local_x_b = local_location.b.x + landmark_x;
-				double local_y_b = local_location.b.y + landmark_y;
-				int pixel_x_b = (image_width / 2.0) + local_x_b * (image_width / 2.0);
-				int pixel_y_b = (image_height / 2.0) + local_y_b * (image_height / 2.0);
-
-				// clip bounds
-				pixel_x_a = std::max(0, std::min(pixel_x_a, image_width - 1));
-				pixel_y_a = std::max(0, std::min(pixel_y_a, image_height - 1));
-				pixel_x_b = std::max(0, std::min(pixel_x_b, image_width - 1));
-				pixel_y_b = std::max(0, std::min(pixel_y_b, image_height - 1));
-
-				// get pixel value
-				int luminosity_a = image(pixel_y_a, pixel_x_a);
-				int luminosity_b = image(pixel_y_b, pixel_x_b);
-
 				// pixel difference feature
-				int diff = luminosity_a - luminosity_b;
+				int diff = face_image.compute_feature(level, landmark_x, landmark_y, local_location);
 
 				pixel_differences(feature_index, data_index) = diff;
 			}
@@ -388,8 +593,10 @@ namespace lbf {
 
 			assert(shape.rows == _model->_num_landmarks && shape.cols == 2);
 
+			_build_face_images();
 			cv::Mat1d projected_shape = project_current_estimated_shape(augmented_data_index);
-			cv::Mat1b &image = get_image_by_augmented_index(augmented_data_index);
+			FaceImage &face_image = get_face_image_by_augmented_index(augmented_data_index);
+			int level = _model->get_pyramid_level_at_stage(stage);
 
 			assert(projected_shape.rows == _model->_num_landmarks && projected_shape.cols == 2);
 
@@ -397,7 +604,7 @@ namespace lbf {
 				// find leaves
 				Forest* forest = _model->get_forest(stage, landmark_index);
 				std::vector<Node*> leaves;
-				forest->predict(projected_shape, image, leaves);
+				forest->predict(projected_shape, face_image, level, leaves);
 				assert(leaves.size() == forest->get_num_trees());
 				cv::Point2d mean_delta;
 				mean_delta.x = 0;
@@ -429,38 +636,21 @@ namespace lbf {
 			assert(data_index < _validation_corpus->get_num_images());
 
 			cv::Mat1b &image = _validation_corpus->get_image(data_index);
+			infer::Workspace workspace;
+			_model->set_image(workspace, image);
 			cv::Mat1d estimated_shape = _model->_mean_shape.clone();
 			
 			assert(estimated_shape.rows == _model->_num_landmarks && estimated_shape.cols == 2);
 
 			cv::Mat1d &rotation_inv = _validation_corpus->get_rotation_inv(data_index);
 			cv::Point2d &shift_inv_point = _validation_corpus->get_shift_inv(data_index);
+			infer::Transform image_transform = _model->build_transform(rotation_inv, shift_inv_point);
 
 			for(int stage = 0;stage < _model->_num_stages;stage++){
 				if(_model->_training_finished_at_stage[stage] == false){
 					continue;
 				}
-
-				// unnormalize initial shape
-				cv::Mat1d unnormalized_estimated_shape = utils::project_shape(estimated_shape, rotation_inv, shift_inv_point);
-
-				// compute binary features
-				struct liblinear::feature_node* binary_features = _model->compute_binary_features_at_stage(image, unnormalized_estimated_shape, stage);
-
-				for(int landmark_index = 0;landmark_index < _model->_num_landmarks;landmark_index++){
-					struct liblinear::model* model_x = _model->get_linear_model_x_at(stage, landmark_index);
-					struct liblinear::model* model_y = _model->get_linear_model_y_at(stage, landmark_index);
-					assert(model_x != NULL);
-					assert(model_y != NULL);
-
-					double delta_x = liblinear::predict(model_x, binary_features);
-					double delta_y = liblinear::predict(model_y, binary_features);
-
-					// update shape
-					estimated_shape(landmark_index, 0) += delta_x;
-					estimated_shape(landmark_index, 1) += delta_y;
-				}
-				delete[] binary_features;
+				_model->estimate_shape_at_stage(workspace, image_transform, stage, estimated_shape);
 			}
 
 			if(transform){
@@ -472,33 +662,353 @@ namespace lbf {
 		void Trainer::evaluate_stage(int target_stage){
 			cout << "validation stage: " << (target_stage + 1) << " of " << _model->_num_stages << endl;
 
-			int num_data = _validation_corpus->get_num_images();
-			std::vector<double> average_error_at_stage(target_stage + 1);
-			for(int stage = 0;stage <= target_stage;stage++){
-				average_error_at_stage[stage] = 0;	
+			assert(target_stage < _model->_num_stages);
+
+			// only the stages that were not evaluated yet are run, starting from the cached shapes
+			while(_validation_error_at_stage.size() <= target_stage){
+				_evaluate_next_stage();
 			}
 
-			for(int data_index = 0;data_index < num_data;data_index++){
-					cv::Mat1b &image = _validation_corpus->get_image(data_index);
+			std::cout << "validation error: " << std::endl;
+			for(int stage = 0;stage <= target_stage;stage++){
+				std::cout << "	stage " << stage << ": " << _validation_error_at_stage[stage] << " %" << std::endl;
+			}
+		}
+		// runs one more stage on every validation image in parallel
+		void Trainer::_evaluate_next_stage(){
+			int stage = _validation_error_at_stage.size();
+			int num_data = _validation_corpus->get_num_images();
+			std::vector<cv::Mat1d> estimated_shapes(num_data);
+			std::vector<double> errors(num_data);
+
+			#pragma omp parallel
+			{
+				infer::Workspace workspace;		// per thread
+				#pragma omp for schedule(dynamic)
+				for(int data_index = 0;data_index < num_data;data_index++){
+					cv::Mat1d estimated_shape;
+					if(stage == 0){
+						estimated_shape = _model->_mean_shape.clone();
+					}else{
+						estimated_shape = _validation_estimated_shapes_at_stage[stage - 1][data_index].clone();
+					}
+					if(_model->_training_finished_at_stage[stage]){
+						cv::Mat1b &image = _validation_corpus->get_image(data_index);
+						cv::Mat1d &rotation_inv = _validation_corpus->get_rotation_inv(data_index);
+						cv::Point2d &shift_inv_point = _validation_corpus->get_shift_inv(data_index);
+						infer::Transform image_transform = _model->build_transform(rotation_inv, shift_inv_point);
+						_model->set_image(workspace, image);
+						_model->estimate_shape_at_stage(workspace, image_transform, stage, estimated_shape);
+					}
 					cv::Mat1d &target_shape = _validation_corpus->get_normalized_shape(data_index);
-					cv::Mat1d &rotation_inv = _validation_corpus->get_rotation_inv(data_index);
-					cv::Point2d &shift_inv_point = _validation_corpus->get_shift_inv(data_index);
-					cv::Mat1d shift_inv = cv::point_to_mat(shift_inv_point);
 					double pupil_distance = _validation_corpus->get_normalized_pupil_distance(data_index);
-					std::vector<double> error_at_stage = _model->compute_error(image, target_shape, rotation_inv, shift_inv, pupil_distance);
-					assert(error_at_stage.size() >= target_stage);
-					for(int stage = 0;stage <= target_stage;stage++){
-						average_error_at_stage[stage] += error_at_stage[stage];
-					}
+					errors[data_index] = _model->compute_mean_error(target_shape, estimated_shape, pupil_distance);
+					estimated_shapes[data_index] = estimated_shape;
+				}
 			}
-			for(int stage = 0;stage <= target_stage;stage++){
-				average_error_at_stage[stage] /= num_data;	
+
+			// reduce in a fixed order so that the error does not depend on the number of threads
+			double average_error = 0;
+			for(int data_index = 0;data_index < num_data;data_index++){
+				average_error += errors[data_index];
 			}
+			average_error /= num_data;
 
-			std::cout << "validation error: " << std::endl;
-			for(int stage = 0;stage < average_error_at_stage.size();stage++){
-				std::cout << "	stage " << stage << ": " << average_error_at_stage[stage] << " %" << std::endl;
+			_validation_estimated_shapes_at_stage.push_back(estimated_shapes);
+			_validation_error_at_stage.push_back(average_error);
+		}
+		// the trainer and its model must not be used from other Python threads until these return
+		// checkpoints the training into a journal. the trainer state with the whole model is rewritten after every stage
+		// and each forest and pair of regressors is appended as soon as its landmark is trained.
+		// if the journal exists the training resumes from it, including the random state and the estimated shapes,
+		// and true is returned. the corpus and the augmentation size must be the same as in the interrupted run.
+		bool Trainer::set_journal(std::string filename){
+			_journal_filename = filename;
+			Journal journal(filename);
+			if(journal.exists() == false){
+				_write_state();
+				return false;
+			}
+			std::vector<JournalRecord> records = journal.read();
+			if(records.size() == 0 || records[0].type != STATE_RECORD || _restore_state(records[0].payload) == false){
+				std::string message = filename + " does not match this training.";
+				PyErr_SetString(PyExc_ValueError, message.c_str());
+				boost::python::throw_error_already_set();
+			}
+			int num_forests = 0;
+			int num_regressors = 0;
+			for(int record_index = 1;record_index < records.size();record_index++){
+				JournalRecord &record = records[record_index];
+				_install_record(record);
+				num_forests += (record.type == FOREST_RECORD) ? 1 : 0;
+				num_regressors += (record.type == REGRESSORS_RECORD) ? 1 : 0;
+			}
+			// drop a torn record at the end before anything is appended
+			journal.reset(records);
+			cout << "resumed from " << filename << " after " << _num_applied_stages << " stages, ";
+			cout << num_forests << " forests and " << num_regressors << " regressors of the next stage" << endl;
+			return true;
+		}
+		std::string Trainer::_serialize_state(){
+			std::ostringstream stream;
+			boost::archive::binary_oarchive oarchive(stream);
+			oarchive << _num_augmented_data;
+			oarchive << _num_features_to_sample;
+			oarchive << *_model;
+			oarchive << _num_applied_stages;
+			std::string random_state = sampler::get_state();
+			oarchive << random_state;
+			for(cv::Mat1d &shape: _augmented_estimated_shapes){
+				for(int landmark_index = 0;landmark_index < _model->_num_landmarks;landmark_index++){
+					oarchive << shape(landmark_index, 0);
+					oarchive << shape(landmark_index, 1);
+				}
+			}
+			for(auto &sampled_feature_locations: _sampled_feature_locations_at_stage){
+				for(FeatureLocation &location: sampled_feature_locations){
+					oarchive << location.a.x;
+					oarchive << location.a.y;
+					oarchive << location.b.x;
+					oarchive << location.b.y;
+				}
+			}
+			return stream.str();
+		}
+		bool Trainer::_restore_state(const std::string &payload){
+			std::istringstream stream(payload);
+			boost::archive::binary_iarchive iarchive(stream);
+			int num_augmented_data = 0;
+			int num_features_to_sample = 0;
+			iarchive >> num_augmented_data;
+			iarchive >> num_features_to_sample;
+			if(num_augmented_data != _num_augmented_data || num_features_to_sample != _num_features_to_sample){
+				return false;
+			}
+			iarchive >> *_model;
+			if(_model->_num_stages != _sampled_feature_locations_at_stage.size()){
+				return false;
+			}
+			iarchive >> _num_applied_stages;
+			std::string random_state;
+			iarchive >> random_state;
+			sampler::set_state(random_state);
+			for(cv::Mat1d &shape: _augmented_estimated_shapes){
+				for(int landmark_index = 0;landmark_index < _model->_num_landmarks;landmark_index++){
+					iarchive >> shape(landmark_index, 0);
+					iarchive >> shape(landmark_index, 1);
+				}
+			}
+			for(auto &sampled_feature_locations: _sampled_feature_locations_at_stage){
+				for(FeatureLocation &location: sampled_feature_locations){
+					iarchive >> location.a.x;
+					iarchive >> location.a.y;
+					iarchive >> location.b.x;
+					iarchive >> location.b.y;
+				}
+			}
+			_forest_restored_at_stage.assign(_model->_num_stages, std::vector<bool>(_model->_num_landmarks, false));
+			_regressors_restored_at_stage.assign(_model->_num_stages, std::vector<bool>(_model->_num_landmarks, false));
+			_validation_error_at_stage.clear();
+			_validation_estimated_shapes_at_stage.clear();
+			return true;
+		}
+		// sets a forest or the regressors of a landmark from a journal record or a result of another process
+		void Trainer::_install_record(const JournalRecord &record){
+			std::istringstream stream(record.payload);
+			boost::archive::binary_iarchive iarchive(stream);
+			if(record.type == FOREST_RECORD){
+				Forest* forest = NULL;
+				iarchive >> forest;
+				delete _model->_forest_at_stage[record.stage][record.landmark_index];
+				_model->_forest_at_stage[record.stage][record.landmark_index] = forest;
+				_forest_restored_at_stage[record.stage][record.landmark_index] = true;
+			}
+			if(record.type == REGRESSORS_RECORD){
+				liblinear::model* model_x = _model->load_liblinear_model(iarchive);
+				liblinear::model* model_y = _model->load_liblinear_model(iarchive);
+				_model->set_linear_models(model_x, model_y, record.stage, record.landmark_index);
+				_regressors_restored_at_stage[record.stage][record.landmark_index] = true;
+			}
+		}
+		// replaces the journal and the state of the cluster with the state after the last applied stage
+		void Trainer::_write_state(){
+			bool coordinator = _cluster_directory.empty() == false && _cluster_coordinator;
+			if(_journal_filename.empty() && coordinator == false){
+				return;
+			}
+			std::string payload = _serialize_state();
+			if(_journal_filename.empty() == false){
+				Journal journal(_journal_filename);
+				if(journal.reset(std::vector<JournalRecord>(1, JournalRecord(STATE_RECORD, -1, -1, payload))) == false){
+					cout << "failed to write " << _journal_filename << endl;
+				}
 			}
+			if(coordinator){
+				Cluster cluster(_cluster_directory);
+				if(cluster.write_state(payload) == false){
+					cout << "failed to write the state to " << _cluster_directory << endl;
+				}
+			}
+		}
+		JournalRecord Trainer::_get_forest_record(int stage, int landmark_index){
+			std::ostringstream stream;
+			{
+				boost::archive::binary_oarchive oarchive(stream);
+				Forest* forest = _model->get_forest(stage, landmark_index);
+				oarchive << forest;
+			}
+			return JournalRecord(FOREST_RECORD, stage, landmark_index, stream.str());
+		}
+		JournalRecord Trainer::_get_regressors_record(int stage, int landmark_index){
+			std::ostringstream stream;
+			{
+				boost::archive::binary_oarchive oarchive(stream);
+				_model->save_liblinear_model(oarchive, _model->get_linear_model_x_at(stage, landmark_index));
+				_model->save_liblinear_model(oarchive, _model->get_linear_model_y_at(stage, landmark_index));
+			}
+			return JournalRecord(REGRESSORS_RECORD, stage, landmark_index, stream.str());
+		}
+		void Trainer::_journal(const JournalRecord &record){
+			if(_journal_filename.empty()){
+				return;
+			}
+			#pragma omp critical(journal)
+			{
+				Journal journal(_journal_filename);
+				journal.append(record);
+			}
+		}
+		// shards the training over the processes that share the cluster directory.
+		// every process first claims the forests or the regressors that no other process has taken,
+		// then waits for the results of the others. each process computes the shapes of the next stage by itself,
+		// so the model is the same as the one a single process trains from the same state.
+		// the coordinator writes the state after every stage and the workers start from it.
+		// all processes need the same corpus and the same arguments. a job whose process died is run again
+		// once its claim file is deleted. a directory is used by one training only.
+		bool Trainer::set_cluster(std::string directory){
+			Cluster cluster(directory);
+			if(cluster.is_writable() == false){
+				std::string message = directory + " is not a writable directory.";
+				PyErr_SetString(PyExc_ValueError, message.c_str());
+				boost::python::throw_error_already_set();
+			}
+			_cluster_directory = directory;
+			_cluster_coordinator = true;
+			std::string payload;
+			if(cluster.read_state(payload) == false){
+				_write_state();
+				return false;
+			}
+			if(_restore_state(payload) == false){
+				std::string message = directory + " does not match this training.";
+				PyErr_SetString(PyExc_ValueError, message.c_str());
+				boost::python::throw_error_already_set();
+			}
+			cout << "resumed from " << directory << " after " << _num_applied_stages << " stages" << endl;
+			return true;
+		}
+		// waits until the coordinator has written the state, at most the cluster timeout
+		void Trainer::join_cluster(std::string directory){
+			Cluster cluster(directory);
+			if(cluster.is_writable() == false){
+				std::string message = directory + " is not a writable directory.";
+				PyErr_SetString(PyExc_ValueError, message.c_str());
+				boost::python::throw_error_already_set();
+			}
+			_cluster_directory = directory;
+			_cluster_coordinator = false;
+			std::string payload;
+			bool timed_out = false;
+			{
+				ScopedGILRelease release;
+				auto start = std::chrono::steady_clock::now();
+				while(cluster.read_state(payload) == false){
+					if(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() > _cluster_timeout){
+						timed_out = true;
+						break;
+					}
+					std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				}
+			}
+			if(timed_out){
+				std::ostringstream message;
+				message << "no coordinator wrote the state to " << directory << " within " << _cluster_timeout << " s.";
+				PyErr_SetString(PyExc_RuntimeError, message.str().c_str());
+				boost::python::throw_error_already_set();
+			}
+			if(_restore_state(payload) == false){
+				std::string message = directory + " does not match this training.";
+				PyErr_SetString(PyExc_ValueError, message.c_str());
+				boost::python::throw_error_already_set();
+			}
+			cout << "joined " << directory << " after " << _num_applied_stages << " stages" << endl;
+		}
+		// a process that stops before it publishes a result fails the stage of the others after the timeout
+		void Trainer::set_cluster_timeout(double seconds){
+			_cluster_timeout = seconds;
+		}
+		int Trainer::_claim(int type, int stage, int landmark_index){
+			if(_cluster_directory.empty()){
+				return CLAIMED;
+			}
+			Cluster cluster(_cluster_directory);
+			return cluster.claim(type, stage, landmark_index);
+		}
+		void Trainer::_publish(const JournalRecord &record){
+			if(_cluster_directory.empty()){
+				return;
+			}
+			Cluster cluster(_cluster_directory);
+			if(cluster.publish(record) == false){
+				cout << "failed to publish to " << _cluster_directory << endl;
+			}
+		}
+		// installs the jobs of the stage that other processes have claimed as soon as their results are published.
+		// sets _cluster_error if a claim file could not be created or no result arrives within the timeout.
+		void Trainer::_collect_results(int type, int stage, std::vector<int> &pending){
+			const char* job = (type == FOREST_RECORD) ? "forest" : "regressors";
+			for(int landmark_index = 0;landmark_index < pending.size();landmark_index++){
+				if(pending[landmark_index] == CLAIM_FAILED){
+					std::ostringstream message;
+					message << "failed to claim the " << job << " of landmark " << landmark_index << " at stage " << stage << " in " << _cluster_directory;
+					_cluster_error = message.str();
+					return;
+				}
+			}
+			Cluster cluster(_cluster_directory);
+			int num_collected = 0;
+			auto last_result = std::chrono::steady_clock::now();
+			for(int landmark_index = 0;landmark_index < pending.size();landmark_index++){
+				if(pending[landmark_index] != CLAIMED_BY_OTHER){
+					continue;
+				}
+				JournalRecord record;
+				while(cluster.read_result(type, stage, landmark_index, record) == false){
+					if(std::chrono::duration<double>(std::chrono::steady_clock::now() - last_result).count() > _cluster_timeout){
+						std::ostringstream message;
+						message << "no result for the " << job << " of landmark " << landmark_index << " at stage " << stage << " in " << _cluster_directory;
+						message << " for " << _cluster_timeout << " s. delete its claim file if the process that claimed it died.";
+						_cluster_error = message.str();
+						return;
+					}
+					std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				}
+				last_result = std::chrono::steady_clock::now();
+				_install_record(record);
+				_journal(record);
+				num_collected++;
+			}
+			if(num_collected > 0){
+				cout << "collected " << num_collected << ((type == FOREST_RECORD) ? " forests" : " pairs of regressors") << " from " << _cluster_directory << endl;
+			}
+		}
+		void Trainer::python_train_stage(int stage){
+			ScopedGILRelease release;
+			train_stage(stage);
+		}
+		void Trainer::python_evaluate_stage(int stage){
+			ScopedGILRelease release;
+			evaluate_stage(stage);
 		}
 	}
 }
\ No newline at end of file
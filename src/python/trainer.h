@@ -1,7 +1,9 @@
 #pragma once
 #include <boost/python/numpy.hpp>
+#include <string>
 #include "../lbf/common.h"
 #include "dataset.h"
+#include "journal.h"
 #include "model.h"
 
 namespace lbf {
@@ -14,15 +16,45 @@ namespace lbf {
 			std::vector<cv::Mat1d> _augmented_estimated_shapes;		// contains normalized shape
 			std::vector<cv::Mat1d> _augmented_target_shapes;		// contains normalized shape
 			std::vector<int> _augmented_indices_to_data_index;
+			std::vector<FaceImage> _training_face_images;
 			std::vector<std::vector<FeatureLocation>> _sampled_feature_locations_at_stage;
+			std::vector<std::vector<cv::Mat1d>> _validation_estimated_shapes_at_stage;	// normalized shape of each validation image after each evaluated stage
+			std::vector<double> _validation_error_at_stage;
+			int _num_applied_stages;		// stages whose prediction is already added to _augmented_estimated_shapes
+			std::string _journal_filename;		// empty : no checkpoints
+			std::vector<std::vector<bool>> _forest_restored_at_stage;
+			std::vector<std::vector<bool>> _regressors_restored_at_stage;
+			Model* _warm_start_model;		// NULL : the regressors start from 0
+			std::vector<bool> _forests_reused_at_stage;		// the stage has the forests of the warm start model
+			std::string _cluster_directory;		// empty : single process
+			bool _cluster_coordinator;
+			double _cluster_timeout;		// seconds without a new result of another process after which a stage fails
+			std::string _cluster_error;		// empty : every job of the stage was trained or collected
+			std::string _serialize_state();
+			bool _restore_state(const std::string &payload);
+			void _write_state();
+			JournalRecord _get_forest_record(int stage, int landmark_index);
+			JournalRecord _get_regressors_record(int stage, int landmark_index);
+			void _install_record(const JournalRecord &record);
+			void _journal(const JournalRecord &record);
+			int _claim(int type, int stage, int landmark_index);
+			void _publish(const JournalRecord &record);
+			void _collect_results(int type, int stage, std::vector<int> &pending);
+			bool _reuse_warm_start_forests(int stage);
+			double* _get_warm_start_weights(Model* model, int stage, int landmark_index, int axis, int num_total_leaves);
+			void _evaluate_next_stage();
 			void _train_forest(int stage, int landmark_index);
 			void _compute_pixel_differences(cv::Mat1d &shape,
-											cv::Mat1b &image,
+											FaceImage &face_image,
+											int level,
 											cv::Mat_<int> &pixel_differences,
 											std::vector<FeatureLocation> &sampled_feature_locations,
+											const infer::PixelDifferenceSampler &sampler,
 											int data_index, 
 											int landmark_index);
 			cv::Mat1b & get_image_by_augmented_index(int augmented_data_index);
+			FaceImage & get_face_image_by_augmented_index(int augmented_data_index);
+			void _build_face_images();
 			int get_data_index_by_augmented_index(int augmented_data_index);
 		public:
 			Corpus* _training_corpus;
@@ -34,11 +66,18 @@ namespace lbf {
 			void train_local_feature_mapping_functions(int stage);
 			void train_global_linear_regression_at_stage(int stage, struct liblinear::feature_node** binary_features);
 			void evaluate_stage(int stage);
+			bool set_journal(std::string filename);
+			bool set_cluster(std::string directory);
+			void join_cluster(std::string directory);
+			void set_cluster_timeout(double seconds);
+			void set_warm_start_model(Model* model);
 			cv::Mat1d project_current_estimated_shape(int augmented_data_index);
 			boost::python::numpy::ndarray python_get_current_estimated_shape(int augmented_data_index, bool transform);
 			boost::python::numpy::ndarray python_get_target_shape(int augmented_data_index, bool transform);
 			boost::python::numpy::ndarray python_get_validation_estimated_shape(int data_index, bool transform);
 			boost::python::numpy::ndarray python_estimate_shape_only_using_local_binary_features(int stage, int augmented_data_index, bool transform);
+			void python_train_stage(int stage);
+			void python_evaluate_stage(int stage);
 		};
 	}
 }
\ No newline at end of file
@@ -0,0 +1,89 @@
+import argparse, os, shutil, subprocess, sys
+import numpy as np
+import lbf
+
+# trains the same model in one process and in a coordinator with several workers, then compares the files
+
+num_landmarks = 68
+num_stages = 2
+
+def build_corpus(num_data, seed):
+	rng = np.random.RandomState(seed)
+	corpus = lbf.corpus()
+	shapes = []
+	for data_index in range(num_data):
+		image = (rng.rand(64, 64) * 255).astype(np.uint8)
+		shape = rng.rand(num_landmarks, 2) * 1.2 - 0.6
+		for (x, y) in shape:
+			x = int(32 + x * 32)
+			y = int(32 + y * 32)
+			image[max(0, y - 2):y + 2, max(0, x - 2):x + 2] = 255
+		rotation = np.eye(2)
+		shift = np.zeros(2)
+		corpus.add(image, shape, shape, rotation, rotation, shift, shift, 0.5)
+		shapes.append(shape)
+	return corpus, np.mean(shapes, axis=0)
+
+def build_trainer():
+	training_corpus, mean_shape = build_corpus(60, 0)
+	validation_corpus, _ = build_corpus(5, 1)
+	model = lbf.model(num_stages=num_stages, num_trees_per_forest=8, tree_depth=4, num_landmarks=num_landmarks, mean_shape_ndarray=mean_shape, feature_radius=[0.3, 0.2])
+	trainer = lbf.trainer(training_corpus=training_corpus, validation_corpus=validation_corpus, model=model, augmentation_size=4, num_features_to_sample=200)
+	return training_corpus, validation_corpus, model, trainer		# the trainer does not keep the corpora alive
+
+def run(directory, role, model_filename):
+	training_corpus, validation_corpus, model, trainer = build_trainer()
+	if role == "worker":
+		trainer.join_cluster(directory)
+	else:
+		trainer.set_cluster(directory)
+	for stage in range(num_stages):
+		trainer.train_stage(stage)
+	if role == "coordinator":
+		model.save(model_filename)
+
+def main():
+	if args.role is not None:
+		run(args.directory, args.role, args.model_filename)
+		return
+	for directory in ["single", "sharded"]:
+		shutil.rmtree(os.path.join(args.work_directory, directory), ignore_errors=True)
+		os.makedirs(os.path.join(args.work_directory, directory))
+	single_directory = os.path.join(args.work_directory, "single")
+	sharded_directory = os.path.join(args.work_directory, "sharded")
+
+	# the state holds the random state, so both trainings start from the same one
+	training_corpus, validation_corpus, model, trainer = build_trainer()
+	trainer.set_cluster(single_directory)
+	shutil.copy(os.path.join(single_directory, "state"), os.path.join(sharded_directory, "state"))
+	for stage in range(num_stages):
+		trainer.train_stage(stage)
+	single_model_filename = os.path.join(args.work_directory, "single.model")
+	model.save(single_model_filename)
+
+	sharded_model_filename = os.path.join(args.work_directory, "sharded.model")
+	command = [sys.executable, __file__, "--directory", sharded_directory, "--model-filename", sharded_model_filename, "--role"]
+	processes = [subprocess.Popen(command + ["coordinator"])]
+	for worker_index in range(args.num_workers):
+		processes.append(subprocess.Popen(command + ["worker"]))
+	for process in processes:
+		assert process.wait() == 0
+
+	claims = [filename for filename in os.listdir(sharded_directory) if filename.endswith(".claim")]
+	print("#jobs:", len(claims))
+	with open(single_model_filename, "rb") as f:
+		single = f.read()
+	with open(sharded_model_filename, "rb") as f:
+		sharded = f.read()
+	print("identical:", single == sharded)
+	assert single == sharded
+
+if __name__ == "__main__":
+	parser = argparse.ArgumentParser()
+	parser.add_argument("--work-directory", "-work", type=str, default="cluster")
+	parser.add_argument("--num-workers", "-workers", type=int, default=3)
+	parser.add_argument("--directory", type=str, default=None)
+	parser.add_argument("--role", type=str, default=None)
+	parser.add_argument("--model-filename", type=str, default=None)
+	args = parser.parse_args()
+	main()
\ No newline at end of file
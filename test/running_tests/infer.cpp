@@ -0,0 +1,42 @@
+#include <opencv2/opencv.hpp>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "../../src/infer/engine.h"
+
+using namespace lbf;
+using std::cout;
+using std::endl;
+
+// ./infer model.lbfi face.jpg
+// estimates the shape of a cropped face with the standalone inference library only
+int main(int argc, char* argv[]){
+	if(argc < 3){
+		cout << "usage: " << argv[0] << " model_filename image_filename" << endl;
+		return 1;
+	}
+	infer::Engine engine;
+	if(engine.load(argv[1]) == false){
+		cout << argv[1] << " could not be loaded." << endl;
+		return 1;
+	}
+	cv::Mat1b image = cv::imread(argv[2], cv::IMREAD_GRAYSCALE);
+	if(image.empty()){
+		cout << argv[2] << " not found." << endl;
+		return 1;
+	}
+	infer::Workspace workspace;
+	std::vector<double> shape(engine.get_num_landmarks() * 2);
+	int num_iterations = 1000;
+	auto start = std::chrono::system_clock::now();
+	for(int iteration = 0;iteration < num_iterations;iteration++){
+		engine.estimate_shape(image.data, image.cols, image.rows, image.step, shape.data(), workspace);
+	}
+	auto end = std::chrono::system_clock::now();
+	double elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+	cout << "estimate_shape: " << elapsed / num_iterations << " us" << endl;
+	for(int landmark_index = 0;landmark_index < engine.get_num_landmarks();landmark_index++){
+		cout << shape[landmark_index * 2 + 0] << ", " << shape[landmark_index * 2 + 1] << endl;
+	}
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include <boost/python/numpy.hpp>
+#include <opencv2/opencv.hpp>
+#include <cstdlib>
+#include <vector>
+#include "../../src/python/corpus.h"
+#include "../../src/python/model.h"
+#include "../../src/python/trainer.h"
+
+// trains complete trees on a few synthetic faces, which leaves pass-through nodes in the trees,
+// and checks that Forest::predict of the training code reaches the same leaves as the inference engine
+// on a box stage and a bilinear stage.
+
+using namespace lbf;
+using namespace lbf::randomforest;
+using namespace lbf::python;
+using std::cout;
+using std::endl;
+namespace np = boost::python::numpy;
+
+const int num_landmarks = 68;
+const int image_size = 64;
+
+Corpus* build_corpus(int num_data, cv::Mat1d &mean_shape){
+	mean_shape = cv::Mat1d(num_landmarks, 2, 0.0);
+	Corpus* corpus = new Corpus();
+	for(int data_index = 0;data_index < num_data;data_index++){
+		cv::Mat1b image(image_size, image_size);
+		for(int y = 0;y < image_size;y++){
+			for(int x = 0;x < image_size;x++){
+				image(y, x) = rand() % 256;
+			}
+		}
+		cv::Mat1d shape(num_landmarks, 2);
+		for(int landmark_index = 0;landmark_index < num_landmarks;landmark_index++){
+			shape(landmark_index, 0) = (rand() / (double)RAND_MAX) * 1.2 - 0.6;
+			shape(landmark_index, 1) = (rand() / (double)RAND_MAX) * 1.2 - 0.6;
+			// bright blob at the landmark
+			int center_x = image_size / 2 + shape(landmark_index, 0) * image_size / 2;
+			int center_y = image_size / 2 + shape(landmark_index, 1) * image_size / 2;
+			for(int y = std::max(0, center_y - 2);y < std::min(image_size, center_y + 2);y++){
+				for(int x = std::max(0, center_x - 2);x < std::min(image_size, center_x + 2);x++){
+					image(y, x) = 255;
+				}
+			}
+		}
+		cv::Mat1d rotation(2, 2, 0.0);
+		rotation(0, 0) = 1;
+		rotation(1, 1) = 1;
+		corpus->_images.push_back(image);
+		corpus->_shapes.push_back(shape);
+		corpus->_normalized_shapes.push_back(shape);
+		corpus->_rotation.push_back(rotation);
+		corpus->_rotation_inv.push_back(rotation);
+		corpus->_shift.push_back(cv::Point2d(0, 0));
+		corpus->_shift_inv.push_back(cv::Point2d(0, 0));
+		corpus->_normalized_pupil_distances.push_back(0.5);
+		mean_shape += shape;
+	}
+	mean_shape /= num_data;
+	return corpus;
+}
+
+int main(){
+	Py_Initialize();
+	np::initialize();
+	srand(0);
+
+	cv::Mat1d mean_shape;
+	cv::Mat1d validation_mean_shape;
+	Corpus* training_corpus = build_corpus(30, mean_shape);
+	Corpus* validation_corpus = build_corpus(5, validation_mean_shape);
+
+	boost::python::tuple size = boost::python::make_tuple(mean_shape.rows, mean_shape.cols);
+	np::ndarray mean_shape_ndarray = np::zeros(size, np::dtype::get_builtin<double>());
+	for(int h = 0;h < mean_shape.rows;h++) {
+		for(int w = 0;w < mean_shape.cols;w++) {
+			mean_shape_ndarray[h][w] = mean_shape(h, w);
+		}
+	}
+
+	int num_stages = 2;
+	std::vector<double> feature_radius{0.3, 0.2};
+	Model* model = new Model(num_stages, 6, 5, num_landmarks, mean_shape_ndarray, feature_radius);
+	model->set_complete_trees(true);
+	model->set_box_features(0, 0.05);
+	model->set_bilinear_features(1, true);
+	Trainer* trainer = new Trainer(training_corpus, validation_corpus, model, 1, 100);
+	for(int stage = 0;stage < num_stages;stage++){
+		trainer->train_stage(stage);
+	}
+
+	infer::Workspace workspace;
+	infer::Transform transform;
+	int num_mismatches = 0;
+	int num_leaves = 0;
+	for(int data_index = 0;data_index < training_corpus->get_num_images();data_index++){
+		cv::Mat1b &image = training_corpus->_images[data_index];
+		FaceImage face_image = model->build_face_image(image);
+		model->set_image(workspace, image);
+		for(int stage = 0;stage < num_stages;stage++){
+			cv::Mat1d shape = mean_shape.clone();
+			model->_engine.estimate_shape_at_stage(stage, transform, shape.ptr<double>(0), workspace);
+			std::vector<int> &engine_leaves = workspace._leaf_indices;
+			int engine_index = 0;
+			int first_leaf = 0;
+			for(int landmark_index = 0;landmark_index < num_landmarks;landmark_index++){
+				Forest* forest = model->get_forest(stage, landmark_index);
+				std::vector<int> leaf_identifiers;
+				forest->predict(mean_shape, face_image, model->get_pyramid_level_at_stage(stage), leaf_identifiers);
+				for(int tree_index = 0;tree_index < forest->get_num_trees();tree_index++){
+					if(engine_leaves[engine_index] != first_leaf + leaf_identifiers[tree_index]){
+						num_mismatches++;
+					}
+					engine_index++;
+					num_leaves++;
+					first_leaf += forest->get_tree_at(tree_index)->get_num_leaves();
+				}
+			}
+		}
+	}
+	cout << num_mismatches << " of " << num_leaves << " leaves differ" << endl;
+
+	delete trainer;
+	delete model;
+	delete training_corpus;
+	delete validation_corpus;
+	return num_mismatches == 0 ? 0 : 1;
+}
\ No newline at end of file
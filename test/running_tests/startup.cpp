@@ -0,0 +1,57 @@
+#include <opencv2/opencv.hpp>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "../../src/infer/engine.h"
+#include "../../src/python/model.h"
+
+using namespace lbf;
+using std::cout;
+using std::endl;
+
+double elapsed_ms(std::chrono::system_clock::time_point start){
+	auto end = std::chrono::system_clock::now();
+	return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+}
+
+// ./startup lbf.model lbf.lbfi face.jpg
+// time to first estimate of a fresh worker with the training model, the flat model read into memory and the flat model mapped.
+// run each case in a new process with a cold page cache for the numbers of a real cold start.
+int main(int argc, char* argv[]){
+	if(argc < 4){
+		cout << "usage: " << argv[0] << " model_filename inference_model_filename image_filename" << endl;
+		return 1;
+	}
+	cv::Mat1b image = cv::imread(argv[3], cv::IMREAD_GRAYSCALE);
+	if(image.empty()){
+		cout << argv[3] << " not found." << endl;
+		return 1;
+	}
+	infer::Workspace workspace;
+	std::vector<double> shape;
+
+	// training model
+	{
+		auto start = std::chrono::system_clock::now();
+		python::Model model(argv[1]);
+		double load_time = elapsed_ms(start);
+		shape.resize(model._num_landmarks * 2);
+		model._engine.estimate_shape(image, shape.data(), workspace);
+		cout << "Model: load " << load_time << " ms, first estimate " << elapsed_ms(start) << " ms" << endl;
+	}
+	// flat model
+	for(int mapped = 0;mapped < 2;mapped++){
+		auto start = std::chrono::system_clock::now();
+		infer::Engine engine;
+		bool success = mapped ? engine.map(argv[2]) : engine.load(argv[2]);
+		if(success == false){
+			cout << argv[2] << " could not be loaded." << endl;
+			return 1;
+		}
+		double load_time = elapsed_ms(start);
+		shape.resize(engine.get_num_landmarks() * 2);
+		engine.estimate_shape(image, shape.data(), workspace);
+		cout << (mapped ? "Engine::map" : "Engine::load") << ": load " << load_time << " ms, first estimate " << elapsed_ms(start) << " ms" << endl;
+	}
+	return 0;
+}
\ No newline at end of file